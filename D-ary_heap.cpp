@@ -1,102 +1,1088 @@
 /*D-ary max-heap realization*/
 #include <iostream>
 #include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <charconv>
+#include <type_traits>
+#include <new>
+#include <memory>
+#include <memory_resource>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <xmmintrin.h>
+#endif
 using namespace std;
 
-// Template class for a d-ary max-heap.
+// Size of a cache line on the targets we care about.
+constexpr size_t cacheLineSize = 64;
+
+// Allocator that aligns every allocation to a cache line.
 template<typename T>
-class MaxHeap {
+struct CacheAlignedAllocator {
+    using value_type = T;
+
+    CacheAlignedAllocator() = default;
+    template<typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), align_val_t(cacheLineSize)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, align_val_t(cacheLineSize));
+    }
+
+    template<typename U>
+    bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const CacheAlignedAllocator<U>&) const { return false; }
+};
+
+// Hints the CPU to pull the cache line holding 'p' into cache.
+inline void prefetch(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#endif
+}
+
+// Index of the lowest set bit of a non-zero mask.
+inline int lowestBit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return static_cast<int>(idx);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Calls f(i) for every i in [begin, end), split into contiguous chunks over 'threads'
+// threads; the calling thread takes the first chunk. Returns once every call is done.
+template<typename F>
+void parallelFor(size_t begin, size_t end, unsigned threads, F f) {
+    size_t chunk = (end - begin + threads - 1) / threads;
+    vector<thread> workers;
+    for (size_t lo = begin + chunk; lo < end; lo += chunk) {
+        size_t hi = min(end, lo + chunk);
+        workers.emplace_back([=, &f] {
+            for (size_t i = lo; i < hi; i++)
+                f(i);
+        });
+    }
+    for (size_t i = begin; i < min(end, begin + chunk); i++)
+        f(i);
+    for (auto& w : workers)
+        w.join();
+}
+
+// Vectorized max-of-children kernel for one full sibling group of D values.
+// argmax() returns the position of the first maximum, matching the scalar scan's
+// tie-breaking, or -1 when the vector compare finds no match (NaN in a float group),
+// in which case the caller falls back to the scalar scan. The specializations are
+// picked at compile time from the target ISA; other types and arities are not enabled.
+// The kernels compute a maximum, so the heap only uses them with the default std::less.
+template<typename T, int D>
+struct ChildScan {
+    static constexpr bool enabled = false;
+    static int argmax(const T*) { return -1; }
+};
+
+#if defined(__AVX2__)
+// Broadcasts the maximum lane of 'v' to all lanes.
+inline __m256i broadcastMax(__m256i v) {
+    v = _mm256_max_epi32(v, _mm256_permute2x128_si256(v, v, 1));
+    v = _mm256_max_epi32(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm256_max_epi32(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+inline __m256 broadcastMax(__m256 v) {
+    v = _mm256_max_ps(v, _mm256_permute2f128_ps(v, v, 1));
+    v = _mm256_max_ps(v, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm256_max_ps(v, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+// Bitmask of the lanes of 'v' equal to 'm'.
+inline uint32_t equalLanes(__m256i v, __m256i m) {
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, m))));
+}
+inline uint32_t equalLanes(__m256 v, __m256 m) {
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(v, m, _CMP_EQ_OQ)));
+}
+inline __m256i load8(const int32_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+inline __m256 load8(const float* p) {
+    return _mm256_loadu_ps(p);
+}
+inline __m256i max8(__m256i a, __m256i b) {
+    return _mm256_max_epi32(a, b);
+}
+inline __m256 max8(__m256 a, __m256 b) {
+    return _mm256_max_ps(a, b);
+}
+
+// AVX2, 8 children: one compare and reduce over a single register.
+template<typename T>
+struct ChildScan8 {
+    static constexpr bool enabled = true;
+    static int argmax(const T* p) {
+        auto v = load8(p);
+        uint32_t mask = equalLanes(v, broadcastMax(v));
+        return mask ? lowestBit(mask) : -1;
+    }
+};
+template<> struct ChildScan<int32_t, 8> : ChildScan8<int32_t> {};
+template<> struct ChildScan<float, 8> : ChildScan8<float> {};
+
+#if defined(__AVX512F__)
+// AVX-512, 16 children: the maximum is folded from the two 256-bit halves with the
+// AVX2 steps above, then one 512-bit compare finds its lanes. (The 512-bit shuffles,
+// extracts and _mm512_reduce_max_* set off -Wmaybe-uninitialized in the GCC 12 headers.)
+template<>
+struct ChildScan<int32_t, 16> {
+    static constexpr bool enabled = true;
+    static int argmax(const int32_t* p) {
+        int32_t m = _mm256_cvtsi256_si32(broadcastMax(max8(load8(p), load8(p + 8))));
+        uint32_t mask = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(p), _mm512_set1_epi32(m));
+        return mask ? lowestBit(mask) : -1;
+    }
+};
+template<>
+struct ChildScan<float, 16> {
+    static constexpr bool enabled = true;
+    static int argmax(const float* p) {
+        float m = _mm256_cvtss_f32(broadcastMax(max8(load8(p), load8(p + 8))));
+        uint32_t mask = _mm512_cmp_ps_mask(_mm512_loadu_ps(p), _mm512_set1_ps(m), _CMP_EQ_OQ);
+        return mask ? lowestBit(mask) : -1;
+    }
+};
+#else
+// AVX2, 16 children: two registers folded into one maximum.
+template<typename T>
+struct ChildScan16 {
+    static constexpr bool enabled = true;
+    static int argmax(const T* p) {
+        auto lo = load8(p);
+        auto hi = load8(p + 8);
+        auto m = broadcastMax(max8(lo, hi));
+        uint32_t mask = equalLanes(lo, m) | (equalLanes(hi, m) << 8);
+        return mask ? lowestBit(mask) : -1;
+    }
+};
+template<> struct ChildScan<int32_t, 16> : ChildScan16<int32_t> {};
+template<> struct ChildScan<float, 16> : ChildScan16<float> {};
+#endif
+#endif
+
+// Instrumentation: building with -DHEAP_STATS compiles sift counters into MaxHeap,
+// read back through stats(). Without it the heap derives from an empty counter class
+// whose hooks are empty inline functions, so the hot paths spend neither time nor space.
+#ifdef HEAP_STATS
+constexpr bool statsEnabled = true;
+#else
+constexpr bool statsEnabled = false;
+#endif
+
+// Snapshot of MaxHeap activity returned by stats(). Sifts move a hole rather than
+// swapping, so a level climbed or descended is one element move; per-operation
+// figures follow from dividing by siftUps or siftDowns.
+struct HeapStats {
+    size_t siftUps = 0;
+    size_t siftDowns = 0;
+    size_t upLevels = 0;
+    size_t downLevels = 0;
+    size_t comparisons = 0;
+};
+
+// Counter base of MaxHeap; the primary template is the disabled, empty one.
+template<bool Enabled>
+class HeapCounters {
+protected:
+    void countSiftUp(size_t, size_t) const {}
+    void countSiftDown(size_t, size_t) const {}
+public:
+    // Returns zeros without HEAP_STATS.
+    HeapStats stats() const { return {}; }
+    // Clears the counters; a no-op without HEAP_STATS.
+    void resetStats() {}
+};
+
+// The parallel heapify sifts from several threads, so the counters are relaxed atomics,
+// updated once per sift rather than once per comparison.
+template<>
+class HeapCounters<true> {
 private:
-    // Internal storage for heap elements.
-    vector<T> heap;
-    // Number of children per node (d-ary heap).
-    int d;
+    mutable atomic<size_t> siftUps{0}, siftDowns{0}, upLevels{0}, downLevels{0}, comparisons{0};
+
+    // Adds 'n' to a counter.
+    static void add(atomic<size_t>& counter, size_t n) {
+        counter.fetch_add(n, memory_order_relaxed);
+    }
+protected:
+    // Records one sift-up that climbed 'levels' levels using 'compares' comparisons.
+    void countSiftUp(size_t levels, size_t compares) const {
+        add(siftUps, 1);
+        add(upLevels, levels);
+        add(comparisons, compares);
+    }
+    // Records one sift-down that descended 'levels' levels using 'compares' comparisons.
+    void countSiftDown(size_t levels, size_t compares) const {
+        add(siftDowns, 1);
+        add(downLevels, levels);
+        add(comparisons, compares);
+    }
+public:
+    HeapCounters() = default;
+    // Copies start from the counts of the source; atomics themselves do not copy.
+    HeapCounters(const HeapCounters& other) {
+        *this = other;
+    }
+    HeapCounters& operator=(const HeapCounters& other) {
+        HeapStats s = other.stats();
+        siftUps = s.siftUps;
+        siftDowns = s.siftDowns;
+        upLevels = s.upLevels;
+        downLevels = s.downLevels;
+        comparisons = s.comparisons;
+        return *this;
+    }
 
-    // Swap two elements by reference.
-    void swap(T& a, T& b) {
-        T tmp = a;
-        a = b;
-        b = tmp;
+    // Returns a snapshot of the counters.
+    HeapStats stats() const {
+        HeapStats s;
+        s.siftUps = siftUps.load(memory_order_relaxed);
+        s.siftDowns = siftDowns.load(memory_order_relaxed);
+        s.upLevels = upLevels.load(memory_order_relaxed);
+        s.downLevels = downLevels.load(memory_order_relaxed);
+        s.comparisons = comparisons.load(memory_order_relaxed);
+        return s;
     }
+    // Clears the counters.
+    void resetStats() {
+        *this = HeapCounters();
+    }
+};
 
-    // Heapify down: ensures that the subtree rooted at index 'ind' satisfies the max-heap property.
-    void hDown(int ind) {
-        int max = ind;
-        // Iterate through all d children.
-        for (int i = 1; i <= d; i++) {
-            int child = d * ind + i;
-            // If the child exists and is greater than the current max, update max.
-            if (child < heap.size() && heap[child] > heap[max])
-                max = child;
+// Template class for a d-ary max-heap.
+// The arity is fixed at compile time when D > 0, so the index math folds into
+// shifts for power-of-two arities and the child scan is fully unrolled.
+// With D == 0 the arity is chosen at runtime through the constructor.
+//
+// CacheAligned selects a layout for heaps much larger than L2: the storage is
+// cache-line aligned and the root is preceded by D - 1 padding slots, so the
+// children of node i occupy physical slots D*(i+1) .. D*(i+1) + D - 1. When
+// D * sizeof(T) is a multiple of the line size (or divides it), no sibling group
+// straddles two lines. hDown also prefetches the grandchildren block.
+//
+// Compare orders the elements like std::priority_queue: comp(a, b) is true when
+// 'a' has lower priority than 'b'. The default std::less gives a max-heap and
+// std::greater a min-heap, with no key negation or wrapping.
+//
+// Allocator supplies the storage. It defaults to CacheAlignedAllocator for the
+// cache-aligned layout; a custom allocator used there must provide the alignment itself.
+template<typename T, int D = 0, typename Compare = less<T>, bool CacheAligned = false,
+         typename Allocator = conditional_t<CacheAligned, CacheAlignedAllocator<T>, allocator<T>>>
+class MaxHeap : public HeapCounters<statsEnabled> {
+private:
+    static_assert(D >= 0, "arity must be positive, or 0 for a runtime arity");
+    static_assert(!CacheAligned || D > 0, "the cache-aligned layout needs a compile-time arity");
+
+    // True when the compile-time arity is a power of two.
+    static constexpr bool pow2 = D > 0 && (D & (D - 1)) == 0;
+    // log2(D), meaningful only when 'pow2' holds.
+    static constexpr int shift = [] {
+        int s = 0;
+        while ((1 << s) < D)
+            s++;
+        return s;
+    }();
+
+    // Padding slots in front of the root.
+    static constexpr size_t pad = CacheAligned ? D - 1 : 0;
+    using Storage = vector<T, Allocator>;
+    // True when a plain vector<T> can be adopted as the storage without copying.
+    static constexpr bool adoptsVector = pad == 0 && is_same<Storage, vector<T>>::value;
+
+    // Internal storage for heap elements; logical index i lives at heap[i + pad].
+    Storage heap = Storage(pad);
+    // Number of children per node (d-ary heap), used only when D == 0.
+    int d = D > 0 ? D : 2;
+    // Ordering of the elements.
+    Compare comp;
+
+    // True when 'a' belongs above 'b' in the heap.
+    bool higher(const T& a, const T& b) const {
+        return comp(b, a);
+    }
+
+    // Element at logical index 'i'.
+    T& at(size_t i) {
+        return heap[i + pad];
+    }
+    const T& at(size_t i) const {
+        return heap[i + pad];
+    }
+
+    // Returns the number of children per node.
+    size_t arity() const {
+        if constexpr (D > 0)
+            return D;
+        else
+            return d;
+    }
+
+    // Index of the first child of node 'ind'.
+    size_t firstChild(size_t ind) const {
+        if constexpr (pow2)
+            return (ind << shift) + 1;
+        else
+            return arity() * ind + 1;
+    }
+
+    // Index of the parent of node 'ind' (ind > 0).
+    size_t parentOf(size_t ind) const {
+        if constexpr (pow2)
+            return (ind - 1) >> shift;
+        else
+            return (ind - 1) / arity();
+    }
+
+    // Unrolled scan over a full sibling group of D children starting at 'first'.
+    template<size_t... I>
+    size_t maxChildUnrolled(size_t first, index_sequence<I...>) const {
+        size_t best = first;
+        ((higher(at(first + I + 1), at(best)) ? (void)(best = first + I + 1) : (void)0), ...);
+        return best;
+    }
+
+    // Returns the index of the largest child in the group starting at 'first'.
+    // The caller guarantees that 'first' is a valid index.
+    size_t maxChild(size_t first) const {
+        if constexpr (D > 0) {
+            // Full groups take the vector kernel or the unrolled path; only the last
+            // group can be partial, and it always goes through the bounded loop below.
+            if (first + D <= size()) {
+                if constexpr (ChildScan<T, D>::enabled && is_same<Compare, less<T>>::value) {
+                    int best = ChildScan<T, D>::argmax(&at(first));
+                    if (best >= 0)
+                        return first + best;
+                }
+                return maxChildUnrolled(first, make_index_sequence<D - 1>());
+            }
         }
-        // If a larger child is found, swap and continue heapifying down.
-        if (max != ind) {
-            swap(heap[ind], heap[max]);
-            hDown(max);
+        size_t last = min(first + arity(), size());
+        size_t best = first;
+        for (size_t child = first + 1; child < last; child++) {
+            if (higher(at(child), at(best)))
+                best = child;
         }
+        return best;
+    }
+
+    // Heapify down: ensures that the subtree rooted at index 'ind' satisfies the max-heap property.
+    // The element is held aside while larger children move up into the hole,
+    // and is written once at its final position.
+    void hDown(size_t ind) {
+        T value = std::move(at(ind));
+        size_t first, levels = 0, compares = 0;
+        while ((first = firstChild(ind)) < size()) {
+            if constexpr (CacheAligned) {
+                // The grandchildren form one contiguous block of D * D slots; fetch it
+                // while the children are compared.
+                size_t grand = firstChild(first);
+                if (grand < size()) {
+                    const char* p = reinterpret_cast<const char*>(&at(grand));
+                    const char* last = reinterpret_cast<const char*>(&at(min(grand + D * D, size()) - 1));
+                    for (; p <= last; p += cacheLineSize)
+                        prefetch(p);
+                }
+            }
+            size_t max = maxChild(first);
+            // The child scan, counted per lane on the vector path, and the test against
+            // the held element.
+            compares += min(first + arity(), size()) - first;
+            // Stop once no child is larger than the held element.
+            if (!higher(at(max), value))
+                break;
+            at(ind) = std::move(at(max));
+            ind = max;
+            ++levels;
+        }
+        at(ind) = std::move(value);
+        this->countSiftDown(levels, compares);
     }
 
     // Heapify up: ensures that the element at index 'ind' is moved up to maintain the max-heap property.
-    void hUp(int ind) {
-        // Base case: reached the root.
-        if (ind == 0)
+    // Smaller parents move down into the hole; the element is written once at the end.
+    void hUp(size_t ind) {
+        T value = std::move(at(ind));
+        size_t levels = 0;
+        // Climb until the root or a parent that is not smaller.
+        while (ind > 0) {
+            size_t parent = parentOf(ind);
+            if (!higher(value, at(parent)))
+                break;
+            at(ind) = std::move(at(parent));
+            ind = parent;
+            ++levels;
+        }
+        at(ind) = std::move(value);
+        // Every level climbed took one comparison, plus the one that stopped the climb.
+        this->countSiftUp(levels, levels + (ind > 0));
+    }
+
+    // Restores the heap property over the whole storage, bottom-up.
+    void heapifyAll() {
+        if (size() < 2)
             return;
-        // Calculate parent's index.
-        int parent = (ind - 1) / d;
-        // If current element is greater than its parent, swap and continue heapifying up.
-        if (heap[ind] > heap[parent]) {
-            swap(heap[ind], heap[parent]);
-            hUp(parent);
+        // Start heapifying from the last non-leaf node down to the root.
+        for (size_t i = parentOf(size() - 1) + 1; i-- > 0;)
+            hDown(i);
+    }
+
+    // Minimum number of nodes per thread before a level is heapified in parallel.
+    static constexpr size_t parallelGrain = 4096;
+
+    // Parallel heapifyAll(): the nodes of one level root disjoint subtrees, so each level
+    // is split across 'threads' threads, deepest level first, with a join in between.
+    // Levels too small to share run serially, which covers the top of the tree.
+    // Every node is sifted exactly as in heapifyAll(), so the result is the same array.
+    void heapifyAllParallel(unsigned threads) {
+        if (size() < 2)
+            return;
+        size_t lastParent = parentOf(size() - 1);
+        // Level l spans the indices [starts[l], starts[l + 1]).
+        vector<size_t> starts{ 0 };
+        for (size_t count = 1; starts.back() <= lastParent; count *= arity())
+            starts.push_back(starts.back() + count);
+        for (size_t l = starts.size() - 1; l-- > 0;) {
+            size_t lo = starts[l];
+            size_t hi = min(starts[l + 1], lastParent + 1);
+            if (hi - lo < parallelGrain * threads) {
+                for (size_t i = hi; i-- > lo;)
+                    hDown(i);
+            }
+            else {
+                parallelFor(lo, hi, threads, [this](size_t i) { hDown(i); });
+            }
+        }
+    }
+
+    // Heapifies with 'threads' threads when more than one is asked for.
+    void heapifyAll(unsigned threads) {
+        if (threads > 1)
+            heapifyAllParallel(threads);
+        else
+            heapifyAll();
+    }
+
+    // Restores the heap property after elements were appended behind the first 'n' ones:
+    // each new element is sifted up, or the whole storage is rebuilt bottom-up with
+    // 'threads' threads when that costs less than m sift-ups through the full depth.
+    void restoreAppended(size_t n, unsigned threads) {
+        size_t m = size() - n;
+        // Levels of the grown tree, the cost of one sift-up.
+        size_t depth = 1;
+        for (size_t span = arity(); arity() > 1 && span < n + m; span *= arity())
+            depth++;
+        if (m * depth < n + m) {
+            for (size_t i = n; i < n + m; i++)
+                hUp(i);
+        }
+        else {
+            heapifyAll(threads);
         }
     }
 public:
     // Default constructor.
     MaxHeap() = default;
     // Constructor to initialize a d-ary heap with given number of children 'd'.
+    // Only meaningful for the runtime-arity heap (D == 0).
     MaxHeap(int d) : d(d) {}
+    // Constructor taking an arity (ignored when D > 0) and a comparator instance.
+    MaxHeap(int d, const Compare& comp) : d(d), comp(comp) {}
+    // Constructor taking the allocator for the heap storage.
+    explicit MaxHeap(const Allocator& alloc) : heap(pad, alloc) {}
+    // Constructor taking an arity (ignored when D > 0), a comparator instance and the allocator.
+    MaxHeap(int d, const Compare& comp, const Allocator& alloc) : heap(pad, alloc), d(d), comp(comp) {}
 
     // Inserts a new value into the heap.
     void insert(const T& value) {
         heap.push_back(value); // Add the new value at the end.
-        hUp(heap.size() - 1);  // Restore heap property by moving it up.
+        hUp(size() - 1);  // Restore heap property by moving it up.
+    }
+
+    // Inserts a new value into the heap, moving it into the storage.
+    void insert(T&& value) {
+        heap.push_back(std::move(value));
+        hUp(size() - 1);
+    }
+
+    // Constructs a new value in place from 'args' and inserts it into the heap.
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        heap.emplace_back(std::forward<Args>(args)...);
+        hUp(size() - 1);
+    }
+
+    // Returns the top element (the maximum for the default Compare). The heap must not be empty.
+    const T& top() const {
+        return at(0);
+    }
+
+    // Removes the top element and returns it by move. The heap must not be empty.
+    T pop() {
+        T top = std::move(at(0));
+        T last = std::move(heap.back());
+        heap.pop_back();
+        if (!empty()) {
+            at(0) = std::move(last);
+            hDown(0);
+        }
+        return top;
     }
 
     // Returns a constant reference to the internal heap vector.
-    const vector<T>& getHeap() const {
+    // Not available for the cache-aligned layout; use data() and size() there.
+    const Storage& getHeap() const {
+        static_assert(!CacheAligned, "getHeap() exposes the unpadded layout only");
         return heap;
     }
 
+    // Pointer to the root; the heap occupies data()[0 .. size()).
+    const T* data() const {
+        return heap.data() + pad;
+    }
+
+    // Number of elements in the heap.
+    size_t size() const {
+        return heap.size() - pad;
+    }
+
     // Builds a heap from an unsorted array.
-    void build(const vector<T>& arr) {
-        heap = arr; // Copy the array into the heap.
-        // Start heapifying from the last non-leaf node down to the root.
-        int start = (heap.size() - 1) / d;
-        for (int i = start; i >= 0; i--)
-            hDown(i);
+    // With threads > 1 the lower levels of the tree are heapified in parallel.
+    void build(const vector<T>& arr, unsigned threads = 1) {
+        if constexpr (adoptsVector) {
+            heap = arr; // Copy the array into the heap.
+        }
+        else {
+            heap.resize(pad);
+            heap.insert(heap.end(), arr.begin(), arr.end());
+        }
+        heapifyAll(threads);
+    }
+
+    // Builds a heap from an unsorted array, taking ownership of its buffer.
+    // With padding or a custom allocator the buffer cannot be adopted, so the elements are moved instead.
+    void build(vector<T>&& arr, unsigned threads = 1) {
+        if constexpr (adoptsVector) {
+            heap = std::move(arr);
+        }
+        else {
+            heap.resize(pad);
+            heap.insert(heap.end(), make_move_iterator(arr.begin()), make_move_iterator(arr.end()));
+            arr.clear();
+        }
+        heapifyAll(threads);
     }
 
     // Checks whether the heap is empty.
-    bool empty() {
-        return heap.empty();
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Moves every element of 'other' into this heap and leaves 'other' empty; both heaps
+    // must order their elements alike. The elements are appended and the order is
+    // restored as in push_bulk(). 'threads' applies to a rebuild.
+    void merge(MaxHeap&& other, unsigned threads = 1) {
+        if (&other == this || other.empty())
+            return;
+        if (empty() && heap.get_allocator() == other.heap.get_allocator()) {
+            heap.swap(other.heap);
+            return;
+        }
+        size_t n = size();
+        heap.insert(heap.end(), make_move_iterator(other.heap.begin() + pad), make_move_iterator(other.heap.end()));
+        other.heap.erase(other.heap.begin() + pad, other.heap.end());
+        restoreAppended(n, threads);
+    }
+
+    // Inserts every element of [first, last). The batch is appended first; then each new
+    // element is sifted up, O(m log_d(n + m)), or the whole storage is rebuilt bottom-up,
+    // O(n + m), whichever is cheaper for the batch and heap sizes.
+    template<typename InputIt>
+    void push_bulk(InputIt first, InputIt last) {
+        size_t n = size();
+        heap.insert(heap.end(), first, last);
+        restoreAppended(n, 1);
+    }
+
+    // Inserts every element of 'range'; the elements are moved out of an rvalue range.
+    template<typename Range>
+    void push_bulk(Range&& range) {
+        if constexpr (is_lvalue_reference<Range>::value)
+            push_bulk(std::begin(range), std::end(range));
+        else
+            push_bulk(make_move_iterator(std::begin(range)), make_move_iterator(std::end(range)));
+    }
+
+    // Removes the top min(k, size()) elements and writes them to 'out' by move, highest
+    // first; returns how many were written. Each root moves straight into 'out' and the
+    // last element is sifted down from the root, with no temporary per element.
+    template<typename OutputIt>
+    size_t pop_n(size_t k, OutputIt out) {
+        k = min(k, size());
+        for (size_t i = 0; i < k; i++) {
+            *out++ = std::move(at(0));
+            if (size() > 1)
+                at(0) = std::move(heap.back());
+            heap.pop_back();
+            if (size() > 1)
+                hDown(0);
+        }
+        return k;
     }
 };
 
-int main() {
+// PairingMaxHeap: a meldable heap for workloads that merge often. Each element lives in
+// its own node; a node's children form a sibling list, and merge() links two roots in
+// O(1). pop() melds the root's children in two passes (pairs left to right, then the
+// pairs right to left), O(log n) amortized. The interface follows MaxHeap, and Compare
+// orders the elements the same way. Nodes are drawn from Allocator, rebound to the node
+// type. The heap is movable but not copyable.
+template<typename T, typename Compare = less<T>, typename Allocator = allocator<T>>
+class PairingMaxHeap {
+private:
+    struct Node {
+        T value;
+        Node* child;
+        Node* sibling;
+    };
+    using NodeAllocator = typename allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+    NodeAllocator alloc;
+    Node* root = nullptr;
+    size_t count = 0;
+    Compare comp;
+
+    // True when 'a' belongs above 'b' in the heap.
+    bool higher(const T& a, const T& b) const {
+        return comp(b, a);
+    }
+
+    // Allocates a node holding a value constructed from 'args', with no links.
+    template<typename... Args>
+    Node* newNode(Args&&... args) {
+        Node* node = allocator_traits<NodeAllocator>::allocate(alloc, 1);
+        ::new (static_cast<void*>(node)) Node{ T(std::forward<Args>(args)...), nullptr, nullptr };
+        return node;
+    }
+
+    // Destroys a node and returns its memory.
+    void freeNode(Node* node) {
+        node->~Node();
+        allocator_traits<NodeAllocator>::deallocate(alloc, node, 1);
+    }
+
+    // Links two roots without siblings: the lower one becomes the first child of the other.
+    Node* meld(Node* a, Node* b) {
+        if (!a)
+            return b;
+        if (!b)
+            return a;
+        if (higher(b->value, a->value))
+            swap(a, b);
+        b->sibling = a->child;
+        a->child = b;
+        return a;
+    }
+
+    // Two-pass merge of a sibling list into one root, without recursion.
+    Node* mergePairs(Node* first) {
+        // First pass: meld neighbours pairwise; the results are stacked through 'sibling'.
+        Node* pairs = nullptr;
+        while (first) {
+            Node* a = first;
+            Node* b = a->sibling;
+            first = b ? b->sibling : nullptr;
+            a->sibling = nullptr;
+            if (b)
+                b->sibling = nullptr;
+            Node* pair = meld(a, b);
+            pair->sibling = pairs;
+            pairs = pair;
+        }
+        // Second pass: meld the pairs from the last one back to the first.
+        Node* result = nullptr;
+        while (pairs) {
+            Node* next = pairs->sibling;
+            pairs->sibling = nullptr;
+            result = meld(result, pairs);
+            pairs = next;
+        }
+        return result;
+    }
+
+    // Moves every value of 'other' into a new node drawn from this heap's allocator,
+    // frees the nodes of 'other' and returns the new nodes melded into one root. Used when
+    // the allocators differ, so the nodes themselves cannot change owners.
+    Node* takeValues(PairingMaxHeap& other) {
+        Node* list = nullptr;
+        vector<Node*> pending;
+        if (other.root)
+            pending.push_back(other.root);
+        while (!pending.empty()) {
+            Node* node = pending.back();
+            pending.pop_back();
+            if (node->child)
+                pending.push_back(node->child);
+            if (node->sibling)
+                pending.push_back(node->sibling);
+            Node* copy = newNode(std::move(node->value));
+            copy->sibling = list;
+            list = copy;
+        }
+        other.clear();
+        return mergePairs(list);
+    }
+
+    // Frees every node of the heap.
+    void clear() {
+        vector<Node*> pending;
+        if (root)
+            pending.push_back(root);
+        while (!pending.empty()) {
+            Node* node = pending.back();
+            pending.pop_back();
+            if (node->child)
+                pending.push_back(node->child);
+            if (node->sibling)
+                pending.push_back(node->sibling);
+            freeNode(node);
+        }
+        root = nullptr;
+        count = 0;
+    }
+
+public:
+    // Default constructor.
+    PairingMaxHeap() = default;
+    // Constructor taking a comparator instance and the allocator for the nodes.
+    explicit PairingMaxHeap(const Compare& comp, const Allocator& alloc = Allocator())
+        : alloc(alloc), comp(comp) {}
+
+    PairingMaxHeap(const PairingMaxHeap&) = delete;
+    PairingMaxHeap& operator=(const PairingMaxHeap&) = delete;
+
+    // Move constructor and assignment: take the nodes of 'other' and leave it empty.
+    // As with the standard containers, assignment takes the allocator of 'other' only when
+    // it propagates on move assignment; otherwise, if the allocators differ, the values are
+    // moved one by one into nodes of this heap's allocator.
+    PairingMaxHeap(PairingMaxHeap&& other) noexcept
+        : alloc(std::move(other.alloc)), root(other.root), count(other.count), comp(std::move(other.comp)) {
+        other.root = nullptr;
+        other.count = 0;
+    }
+    PairingMaxHeap& operator=(PairingMaxHeap&& other) noexcept(
+        allocator_traits<NodeAllocator>::propagate_on_container_move_assignment::value ||
+        allocator_traits<NodeAllocator>::is_always_equal::value) {
+        if (this == &other)
+            return *this;
+        clear();
+        swap(comp, other.comp);
+        if constexpr (allocator_traits<NodeAllocator>::propagate_on_container_move_assignment::value) {
+            alloc = std::move(other.alloc);
+        }
+        else if (!(alloc == other.alloc)) {
+            count = other.count;
+            root = takeValues(other);
+            return *this;
+        }
+        swap(root, other.root);
+        swap(count, other.count);
+        return *this;
+    }
+
+    ~PairingMaxHeap() {
+        clear();
+    }
+
+    // Inserts a new value into the heap.
+    void insert(const T& value) {
+        root = meld(root, newNode(value));
+        ++count;
+    }
+
+    // Inserts a new value into the heap, moving it into its node.
+    void insert(T&& value) {
+        root = meld(root, newNode(std::move(value)));
+        ++count;
+    }
+
+    // Constructs a new value in place from 'args' and inserts it into the heap.
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        root = meld(root, newNode(std::forward<Args>(args)...));
+        ++count;
+    }
+
+    // Returns the top element (the maximum for the default Compare). The heap must not be empty.
+    const T& top() const {
+        return root->value;
+    }
+
+    // Removes the top element and returns it by move. The heap must not be empty.
+    T pop() {
+        Node* old = root;
+        T top = std::move(old->value);
+        root = mergePairs(old->child);
+        freeNode(old);
+        --count;
+        return top;
+    }
+
+    // Number of elements in the heap.
+    size_t size() const {
+        return count;
+    }
+
+    // Checks whether the heap is empty.
+    bool empty() const {
+        return count == 0;
+    }
+
+    // Builds a heap from an unsorted array, replacing the current contents.
+    // The elements are linked into one sibling list and merged in two passes, O(n).
+    void build(const vector<T>& arr) {
+        clear();
+        Node* list = nullptr;
+        for (size_t i = arr.size(); i-- > 0;) {
+            Node* node = newNode(arr[i]);
+            node->sibling = list;
+            list = node;
+        }
+        root = mergePairs(list);
+        count = arr.size();
+    }
+
+    // Moves every element of 'other' into this heap and leaves 'other' empty. With equal
+    // allocators the nodes change owners and the roots are linked in O(1); otherwise the
+    // values are moved into new nodes of this heap, O(n).
+    void merge(PairingMaxHeap&& other) {
+        if (&other == this)
+            return;
+        size_t added = other.count;
+        if (alloc == other.alloc) {
+            root = meld(root, other.root);
+            other.root = nullptr;
+            other.count = 0;
+        }
+        else {
+            root = meld(root, takeValues(other));
+        }
+        count += added;
+    }
+};
+
+// Heap variant that draws its memory from a std::pmr::memory_resource, e.g. a
+// monotonic_buffer_resource whose storage is released in one step.
+template<typename T, int D = 0, typename Compare = less<T>>
+using PmrMaxHeap = MaxHeap<T, D, Compare, false, pmr::polymorphic_allocator<T>>;
+
+// MultiQueue: a concurrent, relaxed priority queue built from c * p d-ary heaps.
+// Each shard is a MaxHeap behind its own mutex. push() inserts into a random shard;
+// try_pop() looks at two random shards and pops from the one with the higher top
+// (the "power of two choices"). Threads only ever try-lock shards on the fast path,
+// so they spread out instead of queueing on one lock.
+// Ordering is relaxed: a pop returns an element close to, but not necessarily, the
+// global top. try_pop() only reports an empty queue after a locked sweep over every
+// shard found all of them empty.
+template<typename T, int D = 4, typename Compare = less<T>>
+class MultiQueue {
+private:
+    // One heap with its lock, on its own cache lines to avoid false sharing.
+    struct alignas(cacheLineSize) Shard {
+        mutex lock;
+        MaxHeap<T, D, Compare> heap;
+    };
+
+    vector<Shard> shards;
+    Compare comp;
+
+    // Per-thread xorshift generator for shard selection.
+    static uint64_t nextRandom() {
+        thread_local uint64_t state = 0x9E3779B97F4A7C15ULL ^ hash<thread::id>()(this_thread::get_id());
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    size_t randomShard() {
+        return nextRandom() % shards.size();
+    }
+
+public:
+    // Creates c * threads shards; c = 2 is the usual choice.
+    explicit MultiQueue(size_t threads, size_t c = 2, const Compare& comp = Compare())
+        : shards(max<size_t>(1, c * threads)), comp(comp) {}
+
+    MultiQueue(const MultiQueue&) = delete;
+    MultiQueue& operator=(const MultiQueue&) = delete;
+
+    // Inserts a value into a random shard that is not currently locked.
+    void push(T value) {
+        for (;;) {
+            Shard& shard = shards[randomShard()];
+            unique_lock<mutex> guard(shard.lock, try_to_lock);
+            if (guard.owns_lock()) {
+                shard.heap.insert(std::move(value));
+                return;
+            }
+        }
+    }
+
+    // Pops a high-priority element into 'out'. Returns false if every shard was empty.
+    bool try_pop(T& out) {
+        for (size_t attempt = 0; attempt < 2 * shards.size(); attempt++) {
+            size_t i = randomShard(), j = randomShard();
+            unique_lock<mutex> first(shards[i].lock, try_to_lock);
+            if (!first.owns_lock())
+                continue;
+            Shard* best = shards[i].heap.empty() ? nullptr : &shards[i];
+            unique_lock<mutex> second;
+            if (j != i) {
+                second = unique_lock<mutex>(shards[j].lock, try_to_lock);
+                if (second.owns_lock() && !shards[j].heap.empty()
+                    && (!best || comp(best->heap.top(), shards[j].heap.top())))
+                    best = &shards[j];
+            }
+            if (best) {
+                out = best->heap.pop();
+                return true;
+            }
+        }
+        // The random probes kept missing: fall back to a locked sweep.
+        for (Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            if (!shard.heap.empty()) {
+                out = shard.heap.pop();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Number of shards.
+    size_t shardCount() const {
+        return shards.size();
+    }
+};
+
+// IntWriter: buffered output for integers. Values are formatted with to_chars into a
+// large buffer that is written out with a few big fwrite calls. In binary mode the
+// raw native-endian bytes of each value are written instead, with no separators.
+class IntWriter {
+private:
+    FILE* file;
+    bool binary;
+    vector<char> buffer;
+    size_t used = 0;
+    static constexpr size_t bufferSize = 1 << 16;
+    // Room kept free for one formatted value plus its separator.
+    static constexpr size_t maxItem = 32;
+
+public:
+    explicit IntWriter(FILE* stream, bool binary = false) : file(stream), binary(binary), buffer(bufferSize) {}
+
+    IntWriter(const IntWriter&) = delete;
+    IntWriter& operator=(const IntWriter&) = delete;
+
+    ~IntWriter() {
+        flush();
+    }
+
+    // Write out everything buffered so far.
+    void flush() {
+        if (used > 0)
+            fwrite(buffer.data(), 1, used, file);
+        used = 0;
+        fflush(file);
+    }
+
+    // Append 'value' followed by 'separator' (text mode), or its raw bytes (binary mode).
+    template<typename T>
+    void write(T value, char separator) {
+        static_assert(is_integral<T>::value && sizeof(T) <= 8, "IntWriter writes integers of up to 64 bits");
+        if (buffer.size() - used < maxItem)
+            flush();
+        if (binary) {
+            memcpy(buffer.data() + used, &value, sizeof(T));
+            used += sizeof(T);
+            return;
+        }
+        char* out = to_chars(buffer.data() + used, buffer.data() + buffer.size(), value).ptr;
+        *out++ = separator;
+        used = out - buffer.data();
+    }
+};
+
+// The program entry point can be left out (HEAP_NO_MAIN) to reuse the
+// containers above, e.g. from the benchmark suite.
+#ifndef HEAP_NO_MAIN
+// Builds a heap with arity D from 'tmp' and prints it.
+// D == 0 falls back to the runtime arity 'd'.
+template<int D>
+void buildAndPrint(vector<int>&& tmp, int d, bool binary, unsigned threads) {
+    MaxHeap<int, D> mh(d);
+    mh.build(std::move(tmp), threads);
+    // Output the elements of the heap.
+    IntWriter writer(stdout, binary);
+    for (size_t i = 0; i < mh.size(); i++)
+        writer.write(mh.data()[i], ' ');
+}
+
+// Usage: D-ary_heap [-b] [-t threads] < input
+// -b writes the heap as raw native-endian 32-bit integers instead of text.
+// -t builds the heap with that many threads (default 1, 0 = all hardware threads).
+int main(int argc, char* argv[]) {
+    bool binary = false;
+    unsigned threads = 1;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-b" || arg == "--binary")
+            binary = true;
+        else if ((arg == "-t" || arg == "--threads") && i + 1 < argc)
+            threads = static_cast<unsigned>(stoul(argv[++i]));
+    }
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
     int d, n;
     // Read number of elements and the arity 'd' for the heap.
     cin >> n >> d;
-    // Create a max heap with specified d-ary structure.
-    MaxHeap<int> mh(d);
     vector<int> tmp(n);
     // Read n elements into a temporary vector.
     for (int i = 0; i < n; i++)
         cin >> tmp[i];
-    // Build the heap from the input array.
-    mh.build(tmp);
-    // Retrieve the internal heap vector.
-    vector<int> out = mh.getHeap();
-    // Output the elements of the heap.
-    for (auto item : out)
-        cout << item << " ";
+    // Use a compile-time arity for the common cases, the runtime heap otherwise.
+    switch (d) {
+    case 2: buildAndPrint<2>(std::move(tmp), d, binary, threads); break;
+    case 4: buildAndPrint<4>(std::move(tmp), d, binary, threads); break;
+    case 8: buildAndPrint<8>(std::move(tmp), d, binary, threads); break;
+    default: buildAndPrint<0>(std::move(tmp), d, binary, threads); break;
+    }
     return 0;
 }
+#endif
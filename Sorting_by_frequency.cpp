@@ -2,8 +2,38 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <string_view>
 #include <functional>
 #include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <cstdio>
+#include <stdexcept>
+#include <charconv>
+#include <memory>
+#include <memory_resource>
+#include <iterator>
+#include <limits>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 using namespace std;
 
 // A key-value node structure for use in various data structures.
@@ -11,302 +41,3277 @@ template<typename K, typename V>
 struct KVNode {
     K key;
     V value;
-    // Constructor that initializes key and value.
-    KVNode(K key, V value) : key(key), value(value) {}
+    // Constructor that initializes key and value, moving from the by-value arguments.
+    KVNode(K key, V value) : key(std::move(key)), value(std::move(value)) {}
 };
 
+// Instrumentation: building with -DHEAP_STATS compiles counters into UnorderedMap and
+// MaxHeap, read back through stats(). Without it both derive from empty counter classes
+// whose hooks are empty inline functions, so the hot paths spend neither time nor space.
+#ifdef HEAP_STATS
+constexpr bool statsEnabled = true;
+#else
+constexpr bool statsEnabled = false;
+#endif
+
+// Snapshot of UnorderedMap activity returned by stats(). The counters cover the map's
+// lifetime or the time since resetStats(); the shape fields describe the map now.
+struct MapStats {
+    static constexpr size_t probeBuckets = 8;
+    // probeGroups[i] counts key lookups that inspected i + 1 control groups; the last
+    // bucket also takes every longer probe.
+    size_t probeGroups[probeBuckets] = {};
+    size_t rehashes = 0;     // full or incremental resizes started
+    uint64_t rehashNanos = 0; // time spent inside resize; deferred migration is not included
+    size_t size = 0;
+    size_t capacity = 0;     // slots of the current table
+    size_t tombstones = 0;
+    double loadFactor = 0;   // (size + tombstones) / capacity
+};
+
+// Counter base of UnorderedMap; the primary template is the disabled, empty one.
+template<bool Enabled>
+class MapCounters {
+protected:
+    void countProbe(size_t) const {}
+    int rehashStarted() const { return 0; }
+    void countRehash(int) const {}
+    MapStats counters() const { return {}; }
+public:
+    // Clears the counters; a no-op without HEAP_STATS.
+    void resetStats() {}
+};
+
+template<>
+class MapCounters<true> {
+private:
+    using Clock = chrono::steady_clock;
+    // Lookups are const, so the counters are mutable.
+    mutable MapStats counts;
+protected:
+    // Records a lookup that inspected 'groups' control groups.
+    void countProbe(size_t groups) const {
+        ++counts.probeGroups[min(groups, MapStats::probeBuckets) - 1];
+    }
+    // Starts timing a resize.
+    Clock::time_point rehashStarted() const {
+        return Clock::now();
+    }
+    // Records a resize that began at 'started'.
+    void countRehash(Clock::time_point started) const {
+        ++counts.rehashes;
+        counts.rehashNanos += chrono::duration_cast<chrono::nanoseconds>(Clock::now() - started).count();
+    }
+    MapStats counters() const {
+        return counts;
+    }
+public:
+    // Clears the counters.
+    void resetStats() {
+        counts = MapStats();
+    }
+};
+
+// Snapshot of MaxHeap activity returned by stats(). Sifts move a hole rather than
+// swapping, so a level climbed or descended is one element move; per-operation
+// figures follow from dividing by siftUps or siftDowns.
+struct HeapStats {
+    size_t siftUps = 0;
+    size_t siftDowns = 0;
+    size_t upLevels = 0;
+    size_t downLevels = 0;
+    size_t comparisons = 0;
+};
+
+// Counter base of MaxHeap; the primary template is the disabled, empty one.
+template<bool Enabled>
+class HeapCounters {
+protected:
+    void countSiftUp(size_t, size_t) const {}
+    void countSiftDown(size_t, size_t) const {}
+public:
+    // Returns zeros without HEAP_STATS.
+    HeapStats stats() const { return {}; }
+    // Clears the counters; a no-op without HEAP_STATS.
+    void resetStats() {}
+};
+
+// The parallel heapify sifts from several threads, so the counters are relaxed atomics,
+// updated once per sift rather than once per comparison.
+template<>
+class HeapCounters<true> {
+private:
+    mutable atomic<size_t> siftUps{0}, siftDowns{0}, upLevels{0}, downLevels{0}, comparisons{0};
+
+    // Adds 'n' to a counter.
+    static void add(atomic<size_t>& counter, size_t n) {
+        counter.fetch_add(n, memory_order_relaxed);
+    }
+protected:
+    // Records one sift-up that climbed 'levels' levels using 'compares' comparisons.
+    void countSiftUp(size_t levels, size_t compares) const {
+        add(siftUps, 1);
+        add(upLevels, levels);
+        add(comparisons, compares);
+    }
+    // Records one sift-down that descended 'levels' levels using 'compares' comparisons.
+    void countSiftDown(size_t levels, size_t compares) const {
+        add(siftDowns, 1);
+        add(downLevels, levels);
+        add(comparisons, compares);
+    }
+public:
+    HeapCounters() = default;
+    // Copies start from the counts of the source; atomics themselves do not copy.
+    HeapCounters(const HeapCounters& other) {
+        *this = other;
+    }
+    HeapCounters& operator=(const HeapCounters& other) {
+        HeapStats s = other.stats();
+        siftUps = s.siftUps;
+        siftDowns = s.siftDowns;
+        upLevels = s.upLevels;
+        downLevels = s.downLevels;
+        comparisons = s.comparisons;
+        return *this;
+    }
+
+    // Returns a snapshot of the counters.
+    HeapStats stats() const {
+        HeapStats s;
+        s.siftUps = siftUps.load(memory_order_relaxed);
+        s.siftDowns = siftDowns.load(memory_order_relaxed);
+        s.upLevels = upLevels.load(memory_order_relaxed);
+        s.downLevels = downLevels.load(memory_order_relaxed);
+        s.comparisons = comparisons.load(memory_order_relaxed);
+        return s;
+    }
+    // Clears the counters.
+    void resetStats() {
+        *this = HeapCounters();
+    }
+};
+
+// d-ary heap over KVNodes ordered by key; defined below, used by UnorderedMap::topK.
+template<typename K, typename V, typename Compare = less<K>, typename Allocator = allocator<KVNode<K, V>>>
+class MaxHeap;
+
+// 64x64 -> 128-bit multiply folded to 64 bits by xoring the halves (the wyhash "mum").
+inline uint64_t mulFold(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t high;
+    uint64_t low = _umul128(a, b, &high);
+    return low ^ high;
+#else
+    uint64_t aLow = a & 0xFFFFFFFF, aHigh = a >> 32, bLow = b & 0xFFFFFFFF, bHigh = b >> 32;
+    uint64_t lowLow = aLow * bLow, lowHigh = aLow * bHigh, highLow = aHigh * bLow;
+    uint64_t middle = (lowLow >> 32) + (lowHigh & 0xFFFFFFFF) + (highLow & 0xFFFFFFFF);
+    uint64_t low = (lowLow & 0xFFFFFFFF) | (middle << 32);
+    uint64_t high = aHigh * bHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+    return low ^ high;
+#endif
+}
+
+// Integer mixer (the murmur3 64-bit finalizer): every input bit affects every output
+// bit, so the low bits used for the control-byte tag and the bits used for the probe
+// start are both well distributed, even for strided keys whose low bits are constant.
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Unaligned word loads for the byte hash.
+inline uint64_t load64(const char* p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+inline uint64_t load32(const char* p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Word-at-a-time byte hash in the style of wyhash: 16 bytes per step through mulFold,
+// with the 1..15 byte tail read as at most two overlapping words instead of byte by byte.
+inline uint64_t hashBytes(const char* p, size_t len) {
+    constexpr uint64_t k0 = 0xa0761d6478bd642fULL, k1 = 0xe7037ed1a0b428dbULL;
+    constexpr uint64_t k2 = 0x8ebc6af09c88c6e3ULL, k3 = 0x589965cc75374cc3ULL;
+    uint64_t seed = k0 ^ mulFold(len ^ k0, k1);
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            // Two (possibly overlapping) 4-byte reads from each end of each 8-byte half.
+            size_t half = (len >> 3) << 2;
+            a = (load32(p) << 32) | load32(p + half);
+            b = (load32(p + len - 4) << 32) | load32(p + len - 4 - half);
+        }
+        else if (len > 0) {
+            a = (static_cast<uint64_t>(static_cast<unsigned char>(p[0])) << 16) |
+                (static_cast<uint64_t>(static_cast<unsigned char>(p[len >> 1])) << 8) |
+                static_cast<unsigned char>(p[len - 1]);
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        size_t rest = len;
+        for (; rest > 16; rest -= 16, p += 16)
+            seed = mulFold(load64(p) ^ k1, load64(p + 8) ^ seed);
+        // The last 16 bytes, overlapping the previous block when the length is not a multiple.
+        a = load64(p + rest - 16);
+        b = load64(p + rest - 8);
+    }
+    return mulFold(k1 ^ len, mulFold(a ^ k1, b ^ seed ^ k2) ^ k3);
+}
+
 // Custom hash functor that supports integral types and strings.
-// For other types, std::hash is used.
+// Integers go through mix64; strings through the word-at-a-time hashBytes.
+// For other types, the result of std::hash (often the identity) is mixed as well.
 template<typename Key>
 struct Hash {
     size_t operator()(const Key& key) const {
         if constexpr (is_integral<Key>::value) {
-            // Multiply by a large prime constant for better distribution.
-            return static_cast<size_t>(key * 2654435761UL);
-        }
-        else if constexpr (is_same<Key, string>::value) {
-            // Simple hash for strings using a multiplier of 31.
-            size_t hash = 0;
-            for (char c : key) {
-                hash = hash * 31 + static_cast<size_t>(c);
-            }
-            return hash;
+            return static_cast<size_t>(mix64(static_cast<uint64_t>(key)));
+        }
+        else if constexpr (is_same<Key, string>::value || is_same<Key, string_view>::value) {
+            return static_cast<size_t>(hashBytes(key.data(), key.size()));
         }
         else {
             // Fallback to the standard hash for other types.
-            return std::hash<Key>()(key);
+            return static_cast<size_t>(mix64(std::hash<Key>()(key)));
+        }
+    }
+};
+
+// Helpers for the open-addressing table: control byte states and group probing.
+// A full slot stores the low 7 bits of its hash; empty and deleted slots have the high bit set.
+enum CtrlByte : int8_t {
+    kEmpty = -128,
+    kDeleted = -2
+};
+
+// Index of the lowest set bit of a non-zero mask.
+inline int lowestBit(uint64_t mask) {
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return static_cast<int>(idx);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+// A group of consecutive control bytes that is probed as a unit.
+// Each query returns a bitmask in which the match for byte i is reported at bit
+// (i << shift); the implementation is picked at compile time from the target ISA.
+#if defined(__AVX2__)
+// AVX2: 32 control bytes per compare.
+struct CtrlGroup {
+    static constexpr size_t width = 32;
+    static constexpr int shift = 0;
+    __m256i ctrl;
+
+    explicit CtrlGroup(const int8_t* p) : ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))) {}
+
+    // Positions whose control byte equals the hash tag 'h2'.
+    uint64_t match(int8_t h2) const {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8(h2))));
+    }
+
+    // Positions that are empty.
+    uint64_t matchEmpty() const {
+        return match(kEmpty);
+    }
+
+    // Positions that are empty or deleted (free for insertion): high bit set.
+    uint64_t matchEmptyOrDeleted() const {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(ctrl));
+    }
+
+    // Positions holding a node: high bit clear.
+    uint64_t matchFull() const {
+        return static_cast<uint32_t>(~_mm256_movemask_epi8(ctrl));
+    }
+};
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+// SSE2: 16 control bytes per compare.
+struct CtrlGroup {
+    static constexpr size_t width = 16;
+    static constexpr int shift = 0;
+    __m128i ctrl;
+
+    explicit CtrlGroup(const int8_t* p) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+
+    // Positions whose control byte equals the hash tag 'h2'.
+    uint64_t match(int8_t h2) const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))));
+    }
+
+    // Positions that are empty.
+    uint64_t matchEmpty() const {
+        return match(kEmpty);
+    }
+
+    // Positions that are empty or deleted (free for insertion): high bit set.
+    uint64_t matchEmptyOrDeleted() const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+    }
+
+    // Positions holding a node: high bit clear.
+    uint64_t matchFull() const {
+        return static_cast<uint16_t>(~_mm_movemask_epi8(ctrl));
+    }
+};
+#elif defined(__ARM_NEON)
+// NEON: 16 control bytes per compare. NEON has no movemask, so the byte mask is
+// narrowed to one nibble per byte and only the top bit of each nibble is kept.
+struct CtrlGroup {
+    static constexpr size_t width = 16;
+    static constexpr int shift = 2;
+    int8x16_t ctrl;
+
+    explicit CtrlGroup(const int8_t* p) : ctrl(vld1q_s8(p)) {}
+
+    // Packs a per-byte 0x00/0xFF mask into bit 4i+3 for byte i.
+    static uint64_t toMask(uint8x16_t bytes) {
+        uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(bytes), 4);
+        return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888ULL;
+    }
+
+    // Positions whose control byte equals the hash tag 'h2'.
+    uint64_t match(int8_t h2) const {
+        return toMask(vceqq_s8(ctrl, vdupq_n_s8(h2)));
+    }
+
+    // Positions that are empty.
+    uint64_t matchEmpty() const {
+        return match(kEmpty);
+    }
+
+    // Positions that are empty or deleted (free for insertion): high bit set.
+    uint64_t matchEmptyOrDeleted() const {
+        return toMask(vcltq_s8(ctrl, vdupq_n_s8(0)));
+    }
+
+    // Positions holding a node: high bit clear.
+    uint64_t matchFull() const {
+        return toMask(vcgeq_s8(ctrl, vdupq_n_s8(0)));
+    }
+};
+#else
+// Portable fallback: the group is loaded as one 64-bit word and all eight bytes
+// are tested at once with bit tricks; the match for byte i is its high bit.
+struct CtrlGroup {
+    static constexpr size_t width = 8;
+    static constexpr int shift = 3;
+    static constexpr uint64_t lsbs = 0x0101010101010101ULL;
+    static constexpr uint64_t msbs = 0x8080808080808080ULL;
+    uint64_t word;
+
+    explicit CtrlGroup(const int8_t* ctrl) {
+        memcpy(&word, ctrl, sizeof(word));
+        // Keep byte i of the group in bits 8i..8i+7 regardless of endianness.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+    }
+
+    // Positions whose control byte equals the hash tag 'h2'.
+    // May report a false positive next to a real match, which the key comparison filters out.
+    uint64_t match(int8_t h2) const {
+        uint64_t x = word ^ (lsbs * static_cast<uint8_t>(h2));
+        return (x - lsbs) & ~x & msbs;
+    }
+
+    // Positions that are empty: high bit set and bit 1 clear (deleted is 0xFE).
+    uint64_t matchEmpty() const {
+        return word & ~(word << 6) & msbs;
+    }
+
+    // Positions that are empty or deleted (free for insertion): high bit set.
+    uint64_t matchEmptyOrDeleted() const {
+        return word & msbs;
+    }
+
+    // Positions holding a node: high bit clear.
+    uint64_t matchFull() const {
+        return ~word & msbs;
+    }
+};
+#endif
+
+// Calls f(i) for every i in [begin, end), split into contiguous chunks over 'threads'
+// threads; the calling thread takes the first chunk. Returns once every call is done.
+template<typename F>
+void parallelFor(size_t begin, size_t end, unsigned threads, F f) {
+    size_t chunk = (end - begin + threads - 1) / threads;
+    vector<thread> workers;
+    for (size_t lo = begin + chunk; lo < end; lo += chunk) {
+        size_t hi = min(end, lo + chunk);
+        workers.emplace_back([=, &f] {
+            for (size_t i = lo; i < hi; i++)
+                f(i);
+        });
+    }
+    for (size_t i = begin; i < min(end, begin + chunk); i++)
+        f(i);
+    for (auto& w : workers)
+        w.join();
+}
+
+// Snapshot files: UnorderedMap::saveSnapshot() and MaxHeap::saveSnapshot() write the
+// in-memory arrays as they are, behind a versioned header, so a warm restart maps the
+// file and copies the arrays back without parsing input or rehashing keys. Only
+// trivially copyable keys and values can be stored; the file is tied to the byte order,
+// the node layout and, for maps, the hash function and control group width.
+enum class SnapshotKind : uint32_t {
+    Map = 1,
+    Heap = 2
+};
+
+// Header at the start of a snapshot file. Payload sections follow at 64-byte aligned
+// offsets; 'param' is the slot count of a map or the arity of a heap.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder; // snapshotByteOrder as written by the producing machine.
+    SnapshotKind kind;
+    uint32_t nodeSize; // sizeof the stored node type.
+    uint64_t count; // Stored elements.
+    uint64_t deleted; // Tombstones of a map table.
+    uint64_t param;
+    uint64_t groupWidth; // CtrlGroup::width of a map writer.
+    uint64_t hashCheck; // Hash of a fixed non-zero probe key, to catch a different Hash.
+    uint64_t offset[2]; // Byte offsets of the payload sections.
+    uint64_t length[2]; // Byte lengths of the payload sections.
+};
+
+constexpr char snapshotMagic[8] = { 'H', 'E', 'A', 'P', 'S', 'N', 'A', 'P' };
+constexpr uint32_t snapshotVersion = 2;
+constexpr uint32_t snapshotByteOrder = 0x01020304;
+
+// Writes 'header' and up to two payload sections to 'path', filling in the magic,
+// version and section placement.
+inline void writeSnapshot(const char* path, SnapshotHeader header,
+                          const void* first, size_t firstLength, const void* second, size_t secondLength) {
+    memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = snapshotVersion;
+    header.byteOrder = snapshotByteOrder;
+    const void* data[2] = { first, second };
+    size_t length[2] = { firstLength, secondLength };
+    uint64_t offset = sizeof(SnapshotHeader);
+    for (int i = 0; i < 2; i++) {
+        offset = (offset + 63) & ~uint64_t(63);
+        header.offset[i] = offset;
+        header.length[i] = length[i];
+        offset += length[i];
+    }
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        throw runtime_error(string("cannot create snapshot ") + path);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    uint64_t written = sizeof(header);
+    static const char padding[64] = {};
+    for (int i = 0; i < 2 && ok; i++) {
+        ok = fwrite(padding, 1, header.offset[i] - written, f) == header.offset[i] - written;
+        ok = ok && (length[i] == 0 || fwrite(data[i], 1, length[i], f) == length[i]);
+        written = header.offset[i] + length[i];
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        throw runtime_error(string("cannot write snapshot ") + path);
+}
+
+// MappedSnapshot: a snapshot file mapped read-only (read into memory where mmap is not
+// available). The constructor checks the header against the expected kind and node size
+// and every section against the file size, and throws runtime_error on a mismatch.
+class MappedSnapshot {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    void* mapped = nullptr;
+    vector<char> copy;
+    SnapshotHeader head;
+
+public:
+    MappedSnapshot(const char* path, SnapshotKind kind, size_t nodeSize) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                mapped = p;
+                size = st.st_size;
+                data = static_cast<const char*>(p);
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+#endif
+        if (!mapped) {
+            FILE* f = fopen(path, "rb");
+            if (!f)
+                throw runtime_error(string("cannot open snapshot ") + path);
+            char block[1 << 16];
+            size_t got;
+            while ((got = fread(block, 1, sizeof(block), f)) > 0)
+                copy.insert(copy.end(), block, block + got);
+            fclose(f);
+            data = copy.data();
+            size = copy.size();
+        }
+        if (size < sizeof(SnapshotHeader))
+            throw runtime_error(string("truncated snapshot ") + path);
+        memcpy(&head, data, sizeof(head));
+        if (memcmp(head.magic, snapshotMagic, sizeof(head.magic)) != 0 || head.version != snapshotVersion ||
+            head.byteOrder != snapshotByteOrder)
+            throw runtime_error(string("not a snapshot of this version and byte order: ") + path);
+        if (head.kind != kind || head.nodeSize != nodeSize)
+            throw runtime_error(string("snapshot holds a different structure or node type: ") + path);
+        for (int i = 0; i < 2; i++) {
+            if (head.offset[i] > size || head.length[i] > size - head.offset[i])
+                throw runtime_error(string("truncated snapshot ") + path);
+        }
+    }
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    ~MappedSnapshot() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapped)
+            munmap(mapped, size);
+#endif
+    }
+
+    // The validated header.
+    const SnapshotHeader& header() const {
+        return head;
+    }
+
+    // Start of payload section 'i'.
+    const char* section(int i) const {
+        return data + head.offset[i];
+    }
+};
+
+// Expected number of elements, used to size an UnorderedMap once up front.
+struct ExpectedCount {
+    size_t count;
+};
+
+// Slot node of UnorderedMap. With CachedHash the full hash is stored next to the key,
+// so a rehash never calls the hash function and probes compare hashes before keys.
+template<typename K, typename V, bool CachedHash>
+struct HashNode {
+    K key;
+    V value;
+};
+template<typename K, typename V>
+struct HashNode<K, V, true> {
+    K key;
+    V value;
+    size_t hash;
+};
+
+// UnorderedMap: a flat hash table using open addressing with SwissTable-style control bytes.
+// Nodes live in one contiguous array whose size is a power of two; a parallel array of
+// control bytes holds a 7-bit hash tag per slot, so most probes never touch a node
+// whose key does not match.
+// In incremental mode a resize keeps the old table alive and migrates a bounded number
+// of its slots on every insert or erase, so no single call pays for the whole rehash.
+// Allocator supplies the memory for both arrays; it is rebound to the control bytes and
+// to the internal node type, as std::unordered_map does with its value_type.
+// CacheHash stores each node's hash in the node; it is on by default for keys that are
+// costly to hash or compare, such as strings, and off for arithmetic keys.
+template<typename Key, typename Value, typename Hash = Hash<Key>,
+         typename Allocator = allocator<pair<const Key, Value>>,
+         bool CacheHash = !is_arithmetic<Key>::value>
+class UnorderedMap : public MapCounters<statsEnabled> {
+private:
+    // Internal node structure for each slot.
+    using Node = HashNode<Key, Value, CacheHash>;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    using CtrlAllocator = typename allocator_traits<Allocator>::template rebind_alloc<int8_t>;
+    using NodeAllocator = typename allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+    // Control bytes: one per slot, followed by a copy of the first group so that
+    // a group load starting near the end of the table never wraps around.
+    vector<int8_t, CtrlAllocator> ctrl;
+    // Slots: raw storage for a flat array of nodes; a node is constructed only where
+    // the control byte is full, so a new table costs no per-slot initialization.
+    NodeAllocator nodeAlloc;
+    Node* slots = nullptr;
+    size_t mask; // Slot count minus one; the slot count is a power of two.
+    Hash hashFunc; // Hash function object.
+    size_t numElements; // Total number of stored elements.
+    size_t numDeleted; // Number of deleted slots (tombstones).
+    size_t growthLimit; // Full plus deleted slots allowed before rehashing.
+    static constexpr float loadFactor = 0.875f; // Threshold for rehashing.
+
+    // Table being drained by an incremental resize; empty when no resize is in progress.
+    // Migrated and erased slots are marked deleted, so lookups never see them twice.
+    vector<int8_t, CtrlAllocator> oldCtrl;
+    Node* oldSlots = nullptr;
+    size_t oldMask = 0;
+    size_t oldLive = 0; // Live nodes still in the old table; counted in numElements too.
+    size_t migratePos = 0; // Next old slot to migrate.
+    bool incremental = false; // Resize incrementally instead of in one pass.
+    static constexpr size_t migrateStep = 64; // Old slots migrated per insert or erase.
+    // Control bytes of the next, doubled table, filled with kEmpty a chunk per insert once
+    // the table passes prepareLoad, so that an incremental resize clears nothing itself.
+    vector<int8_t, CtrlAllocator> nextCtrl;
+    static constexpr size_t prepareStep = 32; // Control bytes filled per insert.
+    static constexpr float prepareLoad = 0.625f;
+
+    // Splits a hash into the probe start (h1) and the 7-bit tag stored in the control byte (h2).
+    static size_t H1(size_t hash) {
+        return hash >> 7;
+    }
+    static int8_t H2(size_t hash) {
+        return static_cast<int8_t>(hash & 0x7F);
+    }
+
+    // Slot count whose growth limit admits 'n' elements without a rehash.
+    static size_t capacityFor(size_t n) {
+        return roundUpCapacity((n * 8 + 6) / 7);
+    }
+
+    // Key and value of a bulk-inserted entry, either a KVNode or a pair.
+    template<typename K, typename V>
+    static const K& entryKey(const KVNode<K, V>& entry) {
+        return entry.key;
+    }
+    template<typename K, typename V>
+    static const V& entryValue(const KVNode<K, V>& entry) {
+        return entry.value;
+    }
+    template<typename K, typename V>
+    static const K& entryKey(const pair<K, V>& entry) {
+        return entry.first;
+    }
+    template<typename K, typename V>
+    static const V& entryValue(const pair<K, V>& entry) {
+        return entry.second;
+    }
+
+    // Smallest power of two that is at least 'n' and at least one group wide.
+    static size_t roundUpCapacity(size_t n) {
+        size_t capacity = CtrlGroup::width;
+        while (capacity < n)
+            capacity <<= 1;
+        return capacity;
+    }
+
+    // Allocates an empty table with 'capacity' slots (a power of two).
+    // The previous slot array must already have been released or handed to oldSlots.
+    // Control bytes already prepared for this capacity are taken over as they are.
+    void initTable(size_t capacity) {
+        if (nextCtrl.size() == capacity + CtrlGroup::width)
+            ctrl.swap(nextCtrl);
+        else
+            ctrl.assign(capacity + CtrlGroup::width, kEmpty);
+        nextCtrl = vector<int8_t, CtrlAllocator>(ctrl.get_allocator());
+        slots = allocator_traits<NodeAllocator>::allocate(nodeAlloc, capacity);
+        // Touch the storage once up front, which is cheaper than faulting it in at random
+        // during inserts; an incremental resize skips this to keep the triggering call short.
+        if (!incremental)
+            memset(static_cast<void*>(slots), 0, capacity * sizeof(Node));
+        mask = capacity - 1;
+        numElements = 0;
+        numDeleted = 0;
+        growthLimit = static_cast<size_t>(capacity * loadFactor);
+    }
+
+    // Constructs a node with the given key, value and key hash in the unused slot 'node'.
+    template<typename K, typename V>
+    static void constructNode(Node* node, size_t hash, K&& key, V&& value) {
+        if constexpr (CacheHash)
+            ::new (static_cast<void*>(node)) Node{ std::forward<K>(key), std::forward<V>(value), hash };
+        else
+            ::new (static_cast<void*>(node)) Node{ std::forward<K>(key), std::forward<V>(value) };
+    }
+
+    // Hash of a stored node: the cached one, or recomputed from the key.
+    size_t nodeHash(const Node& node) const {
+        if constexpr (CacheHash)
+            return node.hash;
+        else
+            return hashFunc(node.key);
+    }
+
+    // False when the cached hash of 'node' rules out a match; then the keys are not compared.
+    static bool hashMayMatch(const Node& node, size_t hash) {
+        if constexpr (CacheHash)
+            return node.hash == hash;
+        else
+            return true;
+    }
+
+    // Destroys the live nodes of a table and returns its slot array to the allocator.
+    void freeTable(const vector<int8_t, CtrlAllocator>& ctrlBytes, Node*& nodes, size_t tableMask) {
+        if (nodes == nullptr)
+            return;
+        for (size_t i = 0; i <= tableMask; i++) {
+            if (ctrlBytes[i] >= 0)
+                nodes[i].~Node();
+        }
+        allocator_traits<NodeAllocator>::deallocate(nodeAlloc, nodes, tableMask + 1);
+        nodes = nullptr;
+    }
+
+    // Places a copy of 'node' into the current table; the key must not be present.
+    void insertUnique(const Node& node) {
+        size_t hash = nodeHash(node);
+        size_t idx = findInsertSlot(hash);
+        constructNode(&slots[idx], hash, node.key, node.value);
+        setCtrl(idx, H2(hash));
+        ++numElements;
+    }
+
+    // Sets the control byte of slot 'i' of a table, keeping its cloned tail group in sync.
+    static void setCtrlIn(int8_t* ctrlBytes, size_t tableMask, size_t i, int8_t value) {
+        ctrlBytes[i] = value;
+        if (i < CtrlGroup::width)
+            ctrlBytes[tableMask + 1 + i] = value;
+    }
+
+    // Sets the control byte of slot 'i' of the current table.
+    void setCtrl(size_t i, int8_t value) {
+        setCtrlIn(ctrl.data(), mask, i, value);
+    }
+
+    // Returns the slot index of 'key' in the given table, or npos if the key is absent.
+    // Groups are visited in triangular order, which covers the whole table.
+    size_t probe(const int8_t* ctrlBytes, const Node* nodes, size_t tableMask,
+                 const Key& key, size_t hash) const {
+        int8_t h2 = H2(hash);
+        size_t pos = H1(hash) & tableMask;
+        for (size_t step = CtrlGroup::width;; step += CtrlGroup::width) {
+            CtrlGroup group(ctrlBytes + pos);
+            for (uint64_t m = group.match(h2); m; m &= m - 1) {
+                size_t idx = (pos + (lowestBit(m) >> CtrlGroup::shift)) & tableMask;
+                if (hashMayMatch(nodes[idx], hash) && nodes[idx].key == key) {
+                    this->countProbe(step / CtrlGroup::width);
+                    return idx;
+                }
+            }
+            // An empty slot ends the probe sequence: the key was never placed further on.
+            if (group.matchEmpty()) {
+                this->countProbe(step / CtrlGroup::width);
+                return npos;
+            }
+            pos = (pos + step) & tableMask;
+        }
+    }
+
+    // Returns the slot index holding 'key' in the current table, or npos if it is absent.
+    size_t findIndex(const Key& key, size_t hash) const {
+        return probe(ctrl.data(), slots, mask, key, hash);
+    }
+
+    // Returns the slot index holding 'key' in the table being migrated, or npos.
+    size_t findOldIndex(const Key& key, size_t hash) const {
+        return migrating() ? probe(oldCtrl.data(), oldSlots, oldMask, key, hash) : npos;
+    }
+
+    // True while an incremental resize is in progress.
+    bool migrating() const {
+        return oldSlots != nullptr;
+    }
+
+    // Calls f(node) for every live node of both tables of 'map', which may be const.
+    // The current table is scanned a control group at a time; its size is a multiple
+    // of the group width.
+    template<typename Map, typename F>
+    static void visitNodes(Map& map, F&& f) {
+        for (size_t pos = 0; pos <= map.mask; pos += CtrlGroup::width) {
+            for (uint64_t m = CtrlGroup(&map.ctrl[pos]).matchFull(); m; m &= m - 1)
+                f(map.slots[pos + (lowestBit(m) >> CtrlGroup::shift)]);
+        }
+        for (size_t i = map.migratePos; map.migrating() && i <= map.oldMask; i++) {
+            if (map.oldCtrl[i] >= 0)
+                f(map.oldSlots[i]);
+        }
+    }
+
+    // Calls f(node) for every live node, as const or mutable nodes.
+    template<typename F>
+    void forEachNode(F&& f) const {
+        visitNodes(*this, f);
+    }
+    template<typename F>
+    void forEachNode(F&& f) {
+        visitNodes(*this, f);
+    }
+
+    // Returns the first empty or deleted slot on the probe sequence of 'hash'.
+    size_t findInsertSlot(size_t hash) const {
+        size_t pos = H1(hash) & mask;
+        for (size_t step = CtrlGroup::width;; step += CtrlGroup::width) {
+            uint64_t m = CtrlGroup(&ctrl[pos]).matchEmptyOrDeleted();
+            if (m)
+                return (pos + (lowestBit(m) >> CtrlGroup::shift)) & mask;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    // Moves the live node in old slot 'i' into the current table.
+    void migrateSlot(size_t i) {
+        if (oldCtrl[i] < 0)
+            return;
+        size_t hash = nodeHash(oldSlots[i]);
+        size_t idx = findInsertSlot(hash);
+        constructNode(&slots[idx], hash, std::move(oldSlots[i].key), std::move(oldSlots[i].value));
+        setCtrl(idx, H2(hash));
+        oldSlots[i].~Node();
+        setCtrlIn(oldCtrl.data(), oldMask, i, kDeleted);
+        --oldLive;
+    }
+
+    // Releases the old table once it holds no live nodes.
+    void dropOldTable() {
+        freeTable(oldCtrl, oldSlots, oldMask);
+        oldCtrl = vector<int8_t, CtrlAllocator>(oldCtrl.get_allocator());
+        oldLive = 0;
+        migratePos = 0;
+    }
+
+    // Migrates up to 'count' old slots; drops the old table when it is drained.
+    void migrate(size_t count) {
+        size_t end = min(oldMask + 1, migratePos + count);
+        for (; migratePos < end && oldLive > 0; migratePos++)
+            migrateSlot(migratePos);
+        if (oldLive == 0)
+            dropOldTable();
+    }
+
+    // Completes an incremental resize in progress.
+    void finishMigration() {
+        if (migrating())
+            migrate(oldMask + 1);
+    }
+
+    // Fills the next chunk of control bytes for a table twice the current size. Between
+    // prepareLoad and loadFactor at least capacity / 4 inserts run, which at prepareStep
+    // bytes each covers the 2 * capacity + width bytes of the next table.
+    void prepareNextCtrl() {
+        size_t target = 2 * (mask + 1) + CtrlGroup::width;
+        if (nextCtrl.capacity() < target)
+            nextCtrl.reserve(target);
+        nextCtrl.insert(nextCtrl.end(), min(prepareStep, target - nextCtrl.size()), kEmpty);
+    }
+
+    // Rehash: moves every node into a fresh table. The slot count doubles unless
+    // most of the used slots are tombstones, in which case they are just dropped.
+    // In incremental mode the old table is kept and drained by later operations.
+    void rehash() {
+        finishMigration();
+        size_t oldCapacity = mask + 1;
+        resize(numElements * 2 >= growthLimit ? oldCapacity * 2 : oldCapacity, incremental);
+    }
+
+    // Moves every node into a fresh table with 'newCapacity' slots, which must hold all of
+    // them below the growth limit. With 'deferred' the nodes are migrated by later calls.
+    void resize(size_t newCapacity, bool deferred) {
+        finishMigration();
+        auto started = this->rehashStarted();
+        size_t oldCapacity = mask + 1;
+        // A moved-from control vector of the same allocator is empty; initTable refills it.
+        oldCtrl = std::move(ctrl);
+        oldSlots = slots;
+        oldMask = mask;
+        oldLive = numElements;
+        migratePos = 0;
+        initTable(newCapacity);
+        numElements = oldLive;
+        // Live nodes stay counted in numElements while they wait in the old table, so the
+        // growth check in tryEmplaceImpl leaves the new table room for all of them.
+        if (deferred && oldLive > 0) {
+            this->countRehash(started);
+            return;
+        }
+        // Move each node to its new slot now.
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldCtrl[i] < 0)
+                continue;
+            size_t hash = nodeHash(oldSlots[i]);
+            size_t idx = findInsertSlot(hash);
+            constructNode(&slots[idx], hash, std::move(oldSlots[i].key), std::move(oldSlots[i].value));
+            setCtrl(idx, H2(hash));
+        }
+        // freeTable destroys the moved-from nodes.
+        dropOldTable();
+        this->countRehash(started);
+    }
+
+    // Find 'key'; if absent, insert a node whose value is constructed from 'args'.
+    // The key and arguments are only consumed when a new node is created.
+    // Returns a pointer to the stored value and whether a new node was inserted.
+    template<typename KeyArg, typename... Args>
+    pair<Value*, bool> tryEmplaceImpl(KeyArg&& key, Args&&... args) {
+        if (migrating())
+            migrate(migrateStep);
+        size_t hash = hashFunc(key);
+        size_t idx = findIndex(key, hash);
+        if (idx != npos)
+            return { &slots[idx].value, false };
+        idx = findOldIndex(key, hash);
+        if (idx != npos)
+            return { &oldSlots[idx].value, false };
+        // Rehash if load factor threshold exceeded.
+        if (numElements + numDeleted >= growthLimit)
+            rehash();
+        else if (incremental && !migrating() && numElements + numDeleted >= (mask + 1) * prepareLoad)
+            prepareNextCtrl();
+        idx = findInsertSlot(hash);
+        bool reused = ctrl[idx] == kDeleted;
+        constructNode(&slots[idx], hash, Key(std::forward<KeyArg>(key)), Value(std::forward<Args>(args)...));
+        if (reused)
+            --numDeleted;
+        setCtrl(idx, H2(hash));
+        ++numElements;
+        return { &slots[idx].value, true };
+    }
+public:
+    // Constructor with an optional initial slot count (default 16), rounded up to a power of two.
+    // Both arrays are allocated from 'alloc'; with a monotonic arena the whole table is
+    // released at once when the arena goes away.
+    explicit UnorderedMap(size_t bucketCount = 16, const Allocator& alloc = Allocator())
+        : ctrl(CtrlAllocator(alloc)), nodeAlloc(alloc), hashFunc(), oldCtrl(CtrlAllocator(alloc)),
+          nextCtrl(CtrlAllocator(alloc)) {
+        initTable(roundUpCapacity(bucketCount));
+    }
+
+    // Constructor with the default slot count and the given allocator.
+    explicit UnorderedMap(const Allocator& alloc) : UnorderedMap(16, alloc) {}
+
+    // Constructor sized so that 'expected.count' elements fit without a rehash.
+    explicit UnorderedMap(ExpectedCount expected, const Allocator& alloc = Allocator())
+        : UnorderedMap(capacityFor(expected.count), alloc) {}
+
+    // Constructor from a range of KVNode or pair entries; see insert_range().
+    template<typename InputIt, typename = typename iterator_traits<InputIt>::iterator_category>
+    UnorderedMap(InputIt first, InputIt last, const Allocator& alloc = Allocator()) : UnorderedMap(alloc) {
+        insert_range(first, last);
+    }
+
+    // Copy constructor: rebuilds the nodes of both tables of 'other' into one table.
+    UnorderedMap(const UnorderedMap& other)
+        : UnorderedMap(other.mask + 1,
+                       allocator_traits<Allocator>::select_on_container_copy_construction(other.get_allocator())) {
+        hashFunc = other.hashFunc;
+        incremental = other.incremental;
+        other.forEachNode([&](const Node& node) { insertUnique(node); });
+    }
+
+    // Move constructor: takes the tables of 'other' and leaves it empty.
+    UnorderedMap(UnorderedMap&& other) : UnorderedMap(CtrlGroup::width, other.get_allocator()) {
+        swap(other);
+    }
+
+    // Copy and move assignment; a moved-from map stays valid. The map keeps its own
+    // allocator: the copy is rebuilt in it, and a move from a map whose allocator differs
+    // copies the nodes rather than taking tables it could not free.
+    UnorderedMap& operator=(const UnorderedMap& other) {
+        if (this != &other) {
+            UnorderedMap copy(other.mask + 1, get_allocator());
+            copy.hashFunc = other.hashFunc;
+            copy.incremental = other.incremental;
+            other.forEachNode([&](const Node& node) { copy.insertUnique(node); });
+            swap(copy);
+        }
+        return *this;
+    }
+    UnorderedMap& operator=(UnorderedMap&& other) {
+        if (nodeAlloc == other.nodeAlloc)
+            swap(other);
+        else
+            *this = static_cast<const UnorderedMap&>(other);
+        return *this;
+    }
+
+    // Destructor: destroys the live nodes and releases both tables.
+    ~UnorderedMap() {
+        freeTable(ctrl, slots, mask);
+        freeTable(oldCtrl, oldSlots, oldMask);
+    }
+
+    // Exchanges the contents of two maps. As with the standard containers, the
+    // allocators are exchanged only when they propagate on swap; otherwise they must
+    // compare equal.
+    void swap(UnorderedMap& other) {
+        if constexpr (allocator_traits<NodeAllocator>::propagate_on_container_swap::value) {
+            using std::swap;
+            swap(nodeAlloc, other.nodeAlloc);
+        }
+        else if (!(nodeAlloc == other.nodeAlloc)) {
+            throw runtime_error("UnorderedMap::swap: allocators differ");
+        }
+        std::swap(ctrl, other.ctrl);
+        std::swap(slots, other.slots);
+        std::swap(mask, other.mask);
+        std::swap(hashFunc, other.hashFunc);
+        std::swap(numElements, other.numElements);
+        std::swap(numDeleted, other.numDeleted);
+        std::swap(growthLimit, other.growthLimit);
+        std::swap(oldCtrl, other.oldCtrl);
+        std::swap(oldSlots, other.oldSlots);
+        std::swap(oldMask, other.oldMask);
+        std::swap(oldLive, other.oldLive);
+        std::swap(migratePos, other.migratePos);
+        std::swap(nextCtrl, other.nextCtrl);
+        std::swap(incremental, other.incremental);
+    }
+
+    // Makes room for 'n' elements in total, so that inserting up to that many does not
+    // rehash. Never shrinks the table; a resize in progress is completed first.
+    void reserve(size_t n) {
+        size_t capacity = capacityFor(n);
+        if (capacity > mask + 1)
+            resize(capacity, false);
+    }
+
+    // Inserts every entry (a KVNode or a pair) of [first, last); an existing key gets the
+    // entry's value, as with insert(). For forward ranges the table is sized once up front
+    // for size() plus the range length, counting duplicates as distinct.
+    template<typename InputIt>
+    void insert_range(InputIt first, InputIt last) {
+        using Category = typename iterator_traits<InputIt>::iterator_category;
+        if constexpr (is_base_of<forward_iterator_tag, Category>::value)
+            reserve(size() + static_cast<size_t>(distance(first, last)));
+        for (; first != last; ++first)
+            insert(entryKey(*first), entryValue(*first));
+    }
+
+    // Builds a map from a range of entries with a single allocation for forward ranges.
+    template<typename InputIt>
+    static UnorderedMap build_from(InputIt first, InputIt last, const Allocator& alloc = Allocator()) {
+        return UnorderedMap(first, last, alloc);
+    }
+
+    // Enables or disables incremental resizing. Disabling it completes a resize in progress.
+    void setIncrementalRehash(bool enabled) {
+        incremental = enabled;
+        if (!enabled)
+            finishMigration();
+    }
+
+    // True while an incremental resize still has nodes to migrate.
+    bool rehashing() const {
+        return migrating();
+    }
+
+    // Returns a copy of the allocator the map was constructed with.
+    Allocator get_allocator() const {
+        return Allocator(nodeAlloc);
+    }
+
+    // Insert a key-value pair into the map. If key exists, update its value.
+    void insert(const Key& key, const Value& value) {
+        auto res = tryEmplaceImpl(key, value);
+        if (!res.second)
+            *res.first = value;
+    }
+
+    // Insert overload that moves the key and value into the map.
+    void insert(Key&& key, Value&& value) {
+        auto res = tryEmplaceImpl(std::move(key), std::move(value));
+        if (!res.second)
+            *res.first = std::move(value);
+    }
+
+    // Construct the value in place from 'args'. If key exists, its value is replaced.
+    // Returns a pointer to the stored value and whether a new node was inserted.
+    template<typename KeyArg, typename... Args>
+    pair<Value*, bool> emplace(KeyArg&& key, Args&&... args) {
+        auto res = tryEmplaceImpl(std::forward<KeyArg>(key), std::forward<Args>(args)...);
+        if (!res.second)
+            *res.first = Value(std::forward<Args>(args)...);
+        return res;
+    }
+
+    // Construct the value in place from 'args' only if the key is absent.
+    // Returns a pointer to the stored value and whether a new node was inserted.
+    template<typename... Args>
+    pair<Value*, bool> try_emplace(const Key& key, Args&&... args) {
+        return tryEmplaceImpl(key, std::forward<Args>(args)...);
+    }
+
+    // try_emplace overload that moves the key into the map.
+    template<typename... Args>
+    pair<Value*, bool> try_emplace(Key&& key, Args&&... args) {
+        return tryEmplaceImpl(std::move(key), std::forward<Args>(args)...);
+    }
+
+    // Erase the element with the given key.
+    bool erase(const Key& key) {
+        if (migrating())
+            migrate(migrateStep);
+        size_t hash = hashFunc(key);
+        size_t idx = findIndex(key, hash);
+        if (idx != npos) {
+            // Leave a tombstone so that probe sequences passing through this slot stay intact.
+            setCtrl(idx, kDeleted);
+            slots[idx].~Node();
+            --numElements;
+            ++numDeleted;
+            return true;
+        }
+        idx = findOldIndex(key, hash);
+        if (idx == npos)
+            return false;
+        // Old-table tombstones are dropped with the old table.
+        setCtrlIn(oldCtrl.data(), oldMask, idx, kDeleted);
+        oldSlots[idx].~Node();
+        --numElements;
+        if (--oldLive == 0)
+            dropOldTable();
+        return true;
+    }
+
+    // Find element by key (non-const version). Returns pointer to value or nullptr.
+    Value* find(const Key& key) {
+        size_t hash = hashFunc(key);
+        size_t idx = findIndex(key, hash);
+        if (idx != npos)
+            return &slots[idx].value;
+        idx = findOldIndex(key, hash);
+        return idx == npos ? nullptr : &oldSlots[idx].value;
+    }
+
+    // Find element by key (const version).
+    const Value* find(const Key& key) const {
+        size_t hash = hashFunc(key);
+        size_t idx = findIndex(key, hash);
+        if (idx != npos)
+            return &slots[idx].value;
+        idx = findOldIndex(key, hash);
+        return idx == npos ? nullptr : &oldSlots[idx].value;
+    }
+
+    // Overload operator[]: if key exists, return reference to its value;
+    // otherwise, insert a default-constructed value and return reference to it.
+    Value& operator[](const Key& key) {
+        return *tryEmplaceImpl(key).first;
+    }
+
+    // operator[] overload that moves the key into the map on insertion.
+    Value& operator[](Key&& key) {
+        return *tryEmplaceImpl(std::move(key)).first;
+    }
+
+    // Number of stored elements.
+    size_t size() const {
+        return numElements;
+    }
+
+    // Returns the probe and rehash counters together with the current table shape.
+    // The counters stay zero unless the program is built with HEAP_STATS.
+    MapStats stats() const {
+        MapStats s = this->counters();
+        s.size = numElements;
+        s.capacity = mask + 1;
+        s.tombstones = numDeleted;
+        s.loadFactor = double(numElements + numDeleted) / double(mask + 1);
+        return s;
+    }
+
+    // Forward iterator over the stored nodes, which expose 'key' and 'value' in place.
+    // The current table is visited first, then the part of the old table that still
+    // waits for migration. The key of a node must not be modified. Any insert or erase
+    // invalidates every iterator, since it may rehash or migrate nodes.
+    template<bool IsConst>
+    class Iterator {
+    private:
+        using MapPtr = conditional_t<IsConst, const UnorderedMap*, UnorderedMap*>;
+        MapPtr map = nullptr;
+        // Slot index; indices past the current table continue into the old table,
+        // and npos is the end.
+        size_t pos = npos;
+
+        template<bool>
+        friend class Iterator;
+        friend class UnorderedMap;
+
+        Iterator(MapPtr map, size_t pos) : map(map), pos(pos) {
+            settle();
+        }
+
+        // Advances 'pos' to the first live slot at or after it, or to the end.
+        // The current table is scanned a control group at a time.
+        void settle() {
+            size_t capacity = map->mask + 1;
+            if (pos < capacity && map->ctrl[pos] >= 0)
+                return;
+            while (pos < capacity) {
+                uint64_t m = CtrlGroup(&map->ctrl[pos]).matchFull();
+                if (m) {
+                    // Bytes past the end of the table are the cloned first group.
+                    pos = min(capacity, pos + (lowestBit(m) >> CtrlGroup::shift));
+                    if (pos < capacity)
+                        return;
+                }
+                else {
+                    pos = min(capacity, pos + CtrlGroup::width);
+                }
+            }
+            if (pos != npos && map->migrating()) {
+                // Slots before migratePos have already moved to the current table.
+                pos = max(pos, capacity + map->migratePos);
+                for (; pos <= capacity + map->oldMask; pos++) {
+                    if (map->oldCtrl[pos - capacity] >= 0)
+                        return;
+                }
+            }
+            pos = npos;
+        }
+
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = Node;
+        using difference_type = ptrdiff_t;
+        using pointer = conditional_t<IsConst, const Node*, Node*>;
+        using reference = conditional_t<IsConst, const Node&, Node&>;
+
+        Iterator() = default;
+
+        // A mutable iterator converts to a const one.
+        template<bool OtherConst, typename = enable_if_t<IsConst && !OtherConst>>
+        Iterator(const Iterator<OtherConst>& other) : map(other.map), pos(other.pos) {}
+
+        reference operator*() const {
+            size_t capacity = map->mask + 1;
+            return pos < capacity ? map->slots[pos] : map->oldSlots[pos - capacity];
+        }
+        pointer operator->() const {
+            return &**this;
+        }
+
+        Iterator& operator++() {
+            ++pos;
+            settle();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return pos == other.pos;
+        }
+        bool operator!=(const Iterator& other) const {
+            return pos != other.pos;
+        }
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    // Iterators over every stored node.
+    iterator begin() {
+        return iterator(this, 0);
+    }
+    iterator end() {
+        return iterator(this, npos);
+    }
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+    const_iterator end() const {
+        return const_iterator(this, npos);
+    }
+    const_iterator cbegin() const {
+        return begin();
+    }
+    const_iterator cend() const {
+        return end();
+    }
+
+    // Calls f(key, value) for every element; the value may be modified in place.
+    template<typename F>
+    void for_each(F&& f) {
+        forEachNode([&](Node& node) { f(static_cast<const Key&>(node.key), node.value); });
+    }
+
+    // Calls f(key, value) for every element.
+    template<typename F>
+    void for_each(F&& f) const {
+        forEachNode([&](const Node& node) { f(node.key, node.value); });
+    }
+
+    // Moves every element out as f(Key&&, Value&&) and leaves the map empty with its
+    // tables released, so a consumer such as a heap takes the nodes without a copy.
+    template<typename F>
+    void drain(F&& f) {
+        forEachNode([&](Node& node) { f(std::move(node.key), std::move(node.value)); });
+        UnorderedMap empty(CtrlGroup::width, get_allocator());
+        empty.hashFunc = hashFunc;
+        empty.incremental = incremental;
+        // The moved-from nodes are destroyed with 'empty'.
+        swap(empty);
+    }
+
+    // Return all entries as a vector of KVNode for external use.
+    vector<KVNode<Key, Value>> getEntries() const {
+        vector<KVNode<Key, Value>> out;
+        out.reserve(numElements);
+        forEachNode([&](const Node& node) {
+            out.emplace_back(node.key, node.value);
+        });
+        return out;
+    }
+
+    // Key whose hash is stored in a snapshot header. A value-initialized key hashes to 0
+    // under most hash functions, so the probe is a fixed non-zero bit pattern.
+    static Key hashProbe() {
+        if constexpr (is_integral<Key>::value) {
+            return static_cast<Key>(0x9e3779b97f4a7c15ull);
+        }
+        else {
+            unsigned char bytes[sizeof(Key)];
+            for (size_t i = 0; i < sizeof(Key); i++)
+                bytes[i] = static_cast<unsigned char>(0x5a + i);
+            Key probe;
+            memcpy(static_cast<void*>(&probe), bytes, sizeof(Key));
+            return probe;
+        }
+    }
+
+    // Writes the table to a snapshot file: the control bytes and the slot array exactly
+    // as they sit in memory. Key and Value must be trivially copyable. A resize in
+    // progress is written from a completed copy.
+    void saveSnapshot(const char* path) const {
+        static_assert(is_trivially_copyable<Node>::value, "snapshots store trivially copyable keys and values");
+        if (migrating()) {
+            UnorderedMap(*this).saveSnapshot(path);
+            return;
+        }
+        SnapshotHeader header{};
+        header.kind = SnapshotKind::Map;
+        header.nodeSize = sizeof(Node);
+        header.count = numElements;
+        header.deleted = numDeleted;
+        header.param = mask + 1;
+        header.groupWidth = CtrlGroup::width;
+        header.hashCheck = hashFunc(hashProbe());
+        writeSnapshot(path, header, ctrl.data(), mask + 1, slots, (mask + 1) * sizeof(Node));
+    }
+
+    // Loads a map written by saveSnapshot() with the same Key, Value, Hash and CacheHash.
+    // The control bytes and slots are copied out of the mapped file as they are, with no
+    // hashing. A file from a build with another control group width is re-inserted
+    // instead, since the probe sequences differ. Throws runtime_error on a bad file.
+    static UnorderedMap loadSnapshot(const char* path, const Allocator& alloc = Allocator()) {
+        static_assert(is_trivially_copyable<Node>::value, "snapshots store trivially copyable keys and values");
+        MappedSnapshot file(path, SnapshotKind::Map, sizeof(Node));
+        const SnapshotHeader& header = file.header();
+        size_t capacity = header.param;
+        UnorderedMap map(CtrlGroup::width, alloc);
+        if (header.hashCheck != map.hashFunc(hashProbe()))
+            throw runtime_error(string("snapshot was written with a different hash function: ") + path);
+        if (capacity < CtrlGroup::width || (capacity & (capacity - 1)) != 0 || header.length[0] != capacity ||
+            header.length[1] != capacity * sizeof(Node) || header.count + header.deleted > capacity)
+            throw runtime_error(string("corrupt snapshot ") + path);
+        const int8_t* ctrlBytes = reinterpret_cast<const int8_t*>(file.section(0));
+        // The control bytes must agree with the header and leave the table within its
+        // load limit, so that every probe sequence still reaches an empty slot.
+        size_t full = 0, deleted = 0, empty = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            if (ctrlBytes[i] >= 0)
+                ++full;
+            else if (ctrlBytes[i] == kDeleted)
+                ++deleted;
+            else if (ctrlBytes[i] == kEmpty)
+                ++empty;
+            else
+                throw runtime_error(string("corrupt snapshot ") + path);
+        }
+        if (full != header.count || deleted != header.deleted || empty == 0 ||
+            full + deleted > static_cast<size_t>(capacity * loadFactor))
+            throw runtime_error(string("corrupt snapshot ") + path);
+        if (header.groupWidth != CtrlGroup::width) {
+            map.reserve(header.count);
+            for (size_t i = 0; i < capacity; i++) {
+                if (ctrlBytes[i] < 0)
+                    continue;
+                Node node;
+                memcpy(static_cast<void*>(&node), file.section(1) + i * sizeof(Node), sizeof(Node));
+                map.insertUnique(node);
+            }
+            return map;
+        }
+        map.freeTable(map.ctrl, map.slots, map.mask);
+        map.ctrl.assign(ctrlBytes, ctrlBytes + capacity);
+        // Clone the first group behind the table, as initTable() lays it out.
+        map.ctrl.insert(map.ctrl.end(), ctrlBytes, ctrlBytes + CtrlGroup::width);
+        map.slots = allocator_traits<NodeAllocator>::allocate(map.nodeAlloc, capacity);
+        memcpy(static_cast<void*>(map.slots), file.section(1), capacity * sizeof(Node));
+        map.mask = capacity - 1;
+        map.numElements = header.count;
+        map.numDeleted = header.deleted;
+        map.growthLimit = static_cast<size_t>(capacity * loadFactor);
+        return map;
+    }
+
+    // Return the k entries with the largest values, ordered from largest to smallest.
+    // A bounded min-heap of size k is kept while scanning the table, so this takes
+    // O(n log k) time and O(k) extra memory instead of sorting every entry.
+    vector<KVNode<Key, Value>> topK(size_t k) const {
+        // Min-heap keyed by value: the root is the smallest of the kept entries.
+        MaxHeap<Value, Key, greater<Value>> best;
+        if (k > 0) {
+            forEachNode([&](const Node& node) {
+                if (best.size() < k)
+                    best.emplace(node.value, node.key);
+                else if (best.top().key < node.value)
+                    best.replaceTop(KVNode<Value, Key>(node.value, node.key));
+            });
+        }
+        // Sorting the min-heap leaves the largest values first.
+        vector<KVNode<Value, Key>> sorted = best.drainSorted();
+        vector<KVNode<Key, Value>> out;
+        out.reserve(sorted.size());
+        for (auto& node : sorted)
+            out.emplace_back(std::move(node.value), std::move(node.key));
+        return out;
+    }
+};
+
+// MaxHeap: a d-ary max heap implementation using KVNode for storage.
+// Compare orders the keys like std::priority_queue: comp(a, b) is true when key 'a'
+// has lower priority than 'b'. The default std::less gives a max-heap and
+// std::greater a min-heap.
+// Allocator supplies the heap storage.
+template<typename K, typename V, typename Compare, typename Allocator>
+class MaxHeap : public HeapCounters<statsEnabled> {
+public:
+    using Storage = vector<KVNode<K, V>, Allocator>;
+
+private:
+    // The heap is stored as a vector of KVNode objects.
+    Storage heap;
+    int d = 2; // d-ary heap (default binary heap)
+    Compare comp; // Key ordering.
+
+    // True when key 'a' belongs above key 'b' in the heap.
+    bool higher(const K& a, const K& b) const {
+        return comp(b, a);
+    }
+
+    // Heapify down: ensures max-heap property from index 'ind' downward.
+    void hDown(int ind) {
+        heapify(heap, ind, static_cast<int>(heap.size()), std::move(heap[ind]));
+    }
+
+    // Heapify up: move the element at index 'ind' up to restore heap property.
+    // Smaller parents move down into the hole; the node is written once at the end.
+    void hUp(int ind) {
+        KVNode<K, V> node = std::move(heap[ind]);
+        size_t levels = 0;
+        while (ind > 0) {
+            int parent = (ind - 1) / d;
+            if (!higher(node.key, heap[parent].key))
+                break;
+            heap[ind] = std::move(heap[parent]);
+            ind = parent;
+            ++levels;
+        }
+        heap[ind] = std::move(node);
+        // Every level climbed took one comparison, plus the one that stopped the climb.
+        this->countSiftUp(levels, levels + (ind > 0));
+    }
+
+    // Heapify helper: places 'node' into the hole at index 'i' of 'arr' and sifts it down,
+    // keeping the max-heap property for arr[0..heapSize). Larger children move up into
+    // the hole one level at a time; 'node' is written once at its final position.
+    void heapify(Storage& arr, int i, int heapSize, KVNode<K, V> node) {
+        size_t levels = 0, compares = 0;
+        for (;;) {
+            int first = d * i + 1;
+            if (first >= heapSize)
+                break;
+            // Find the largest child.
+            int largest = first;
+            int last = min(first + d, heapSize);
+            for (int child = first + 1; child < last; child++) {
+                if (higher(arr[child].key, arr[largest].key))
+                    largest = child;
+            }
+            // The child scan and the test against the held node.
+            compares += last - first;
+            // Stop once no child is larger than the held node.
+            if (!higher(arr[largest].key, node.key))
+                break;
+            arr[i] = std::move(arr[largest]);
+            i = largest;
+            ++levels;
+        }
+        arr[i] = std::move(node);
+        this->countSiftDown(levels, compares);
+    }
+
+    // Sort an array that already satisfies the heap property into ascending order under
+    // Compare (ascending keys for the default max-heap).
+    // The root moves to the end of the shrinking heap and the displaced last element
+    // is sifted down from the root.
+    void sortHeapOrdered(Storage& arr) {
+        for (int i = static_cast<int>(arr.size()) - 1; i > 0; i--) {
+            KVNode<K, V> last = std::move(arr[i]);
+            arr[i] = std::move(arr[0]);
+            heapify(arr, 0, i, std::move(last));
+        }
+    }
+
+    // Restore the heap property over the whole storage, bottom-up.
+    void heapifyAll() {
+        int start = (static_cast<int>(heap.size()) - 1) / d;
+        for (int i = start; heap.size() > 1 && i >= 0; i--)
+            hDown(i);
+    }
+
+    // Restores the heap property after nodes were appended behind the first 'n' ones:
+    // each new node is sifted up, or the whole storage is rebuilt bottom-up with
+    // 'threads' threads when that costs less than m sift-ups through the full depth.
+    void restoreAppended(size_t n, unsigned threads) {
+        size_t m = heap.size() - n;
+        // Levels of the grown tree, the cost of one sift-up.
+        size_t depth = 1;
+        for (size_t span = d; d > 1 && span < n + m; span *= d)
+            depth++;
+        if (m * depth < n + m) {
+            for (size_t i = n; i < n + m; i++)
+                hUp(static_cast<int>(i));
+        }
+        else {
+            heapifyAll(threads);
+        }
+    }
+
+    // Minimum number of nodes per thread before a level is heapified in parallel.
+    static constexpr size_t parallelGrain = 4096;
+
+    // Parallel heapifyAll(): the nodes of one level root disjoint subtrees, so each level
+    // is split across 'threads' threads, deepest level first, with a join in between.
+    // Levels too small to share run serially. The result matches heapifyAll().
+    void heapifyAll(unsigned threads) {
+        if (threads <= 1 || heap.size() < 2) {
+            heapifyAll();
+            return;
+        }
+        size_t lastParent = (heap.size() - 2) / d;
+        // Level l spans the indices [starts[l], starts[l + 1]).
+        vector<size_t> starts{ 0 };
+        for (size_t count = 1; starts.back() <= lastParent; count *= d)
+            starts.push_back(starts.back() + count);
+        for (size_t l = starts.size() - 1; l-- > 0;) {
+            size_t lo = starts[l];
+            size_t hi = min(starts[l + 1], lastParent + 1);
+            if (hi - lo < parallelGrain * threads) {
+                for (size_t i = hi; i-- > lo;)
+                    hDown(static_cast<int>(i));
+            }
+            else {
+                parallelFor(lo, hi, threads, [this](size_t i) { hDown(static_cast<int>(i)); });
+            }
+        }
+    }
+
+public:
+    // Default constructor.
+    MaxHeap() = default;
+    // Constructor to set the arity 'd' for the heap.
+    MaxHeap(int d) : d(d) {}
+    // Constructor taking the arity and a comparator instance.
+    MaxHeap(int d, const Compare& comp) : d(d), comp(comp) {}
+    // Constructor taking the allocator for the heap storage.
+    explicit MaxHeap(const Allocator& alloc) : heap(alloc) {}
+    // Constructor taking the arity, a comparator instance and the allocator.
+    MaxHeap(int d, const Compare& comp, const Allocator& alloc) : heap(alloc), d(d), comp(comp) {}
+
+    // Insert a KVNode into the heap.
+    void insert(const KVNode<K, V>& value) {
+        heap.push_back(value);
+        hUp(heap.size() - 1);
+    }
+
+    // Insert a KVNode into the heap, moving it into the storage.
+    void insert(KVNode<K, V>&& value) {
+        heap.push_back(std::move(value));
+        hUp(heap.size() - 1);
+    }
+
+    // Construct a KVNode in place from 'args' (key, value) and insert it.
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        heap.emplace_back(std::forward<Args>(args)...);
+        hUp(heap.size() - 1);
+    }
+
+    // Returns a constant reference to the internal heap vector.
+    const Storage& getHeap() const {
+        return heap;
+    }
+
+    // Returns the maximum value (at the root of the heap).
+    V getMax() const {
+        return heap[0].value;
+    }
+
+    // Returns the root node. The heap must not be empty.
+    const KVNode<K, V>& top() const {
+        return heap[0];
+    }
+
+    // Replace the root with 'node' and restore the heap property with a single sift.
+    // Cheaper than pop() followed by insert(). The heap must not be empty.
+    void replaceTop(KVNode<K, V> node) {
+        heapify(heap, 0, static_cast<int>(heap.size()), std::move(node));
+    }
+
+    // Number of nodes in the heap.
+    size_t size() const {
+        return heap.size();
+    }
+
+    // Removes the maximum node from the heap and returns it by move.
+    KVNode<K, V> pop() {
+        KVNode<K, V> top = std::move(heap[0]);
+        KVNode<K, V> last = std::move(heap.back());
+        heap.pop_back();
+        if (!heap.empty())
+            heapify(heap, 0, static_cast<int>(heap.size()), std::move(last));
+        return top;
+    }
+
+    // Extracts and removes the maximum element from the heap.
+    V extractMax() {
+        return pop().value;
+    }
+
+    // Build the heap from an unsorted array of KVNodes.
+    // With threads > 1 the lower levels of the tree are heapified in parallel.
+    void build(const vector<KVNode<K, V>>& arr, unsigned threads = 1) {
+        heap.assign(arr.begin(), arr.end());
+        heapifyAll(threads);
+    }
+
+    // Build the heap from an unsorted array, taking ownership of its buffer.
+    // With a custom allocator the buffer cannot be adopted, so the nodes are moved instead.
+    void build(vector<KVNode<K, V>>&& arr, unsigned threads = 1) {
+        if constexpr (is_same<Storage, vector<KVNode<K, V>>>::value) {
+            heap = std::move(arr);
+        } else {
+            heap.assign(make_move_iterator(arr.begin()), make_move_iterator(arr.end()));
+            arr.clear();
+        }
+        heapifyAll(threads);
+    }
+
+    // Check if the heap is empty.
+    bool empty() const {
+        return heap.empty();
+    }
+
+    // Perform heap sort and return a vector of sorted values.
+    vector<V> heapSort() {
+        // Create a copy of the heap; it already satisfies the heap property.
+        Storage arr = heap;
+        sortHeapOrdered(arr);
+        // Extract the sorted values.
+        vector<V> sorted;
+        sorted.reserve(arr.size());
+        for (auto& node : arr) {
+            sorted.push_back(std::move(node.value));
+        }
+        return sorted;
+    }
+
+    // Sort the heap storage in place and move it out, leaving the heap empty.
+    // Nodes come out in the same order as in heapSort(), without copying the heap.
+    Storage drainSorted() {
+        sortHeapOrdered(heap);
+        Storage sorted = std::move(heap);
+        heap.clear();
+        return sorted;
+    }
+
+    // Writes the heap-ordered storage and the arity to a snapshot file.
+    // K and V must be trivially copyable.
+    void saveSnapshot(const char* path) const {
+        static_assert(is_trivially_copyable<KVNode<K, V>>::value, "snapshots store trivially copyable nodes");
+        SnapshotHeader header{};
+        header.kind = SnapshotKind::Heap;
+        header.nodeSize = sizeof(KVNode<K, V>);
+        header.count = heap.size();
+        header.param = static_cast<uint64_t>(d);
+        writeSnapshot(path, header, heap.data(), heap.size() * sizeof(KVNode<K, V>), nullptr, 0);
+    }
+
+    // Loads a heap written by saveSnapshot(). The nodes are already in heap order, so
+    // they are copied out of the mapped file and not re-heapified; 'comp' must order
+    // the keys as the writer's comparator did. Throws runtime_error on a bad file.
+    static MaxHeap loadSnapshot(const char* path, const Compare& comp = Compare(), const Allocator& alloc = Allocator()) {
+        static_assert(is_trivially_copyable<KVNode<K, V>>::value, "snapshots store trivially copyable nodes");
+        MappedSnapshot file(path, SnapshotKind::Heap, sizeof(KVNode<K, V>));
+        const SnapshotHeader& header = file.header();
+        // The section length is bounded by the file size; divide it rather than multiply
+        // the untrusted count, which could wrap around.
+        if (header.param < 1 || header.param > static_cast<uint64_t>(numeric_limits<int>::max()) ||
+            header.length[0] % sizeof(KVNode<K, V>) != 0 || header.count != header.length[0] / sizeof(KVNode<K, V>))
+            throw runtime_error(string("corrupt snapshot ") + path);
+        MaxHeap heap(static_cast<int>(header.param), comp, alloc);
+        heap.heap.assign(header.count, KVNode<K, V>(K(), V()));
+        if (header.count > 0)
+            memcpy(static_cast<void*>(heap.heap.data()), file.section(0), header.length[0]);
+        return heap;
+    }
+
+    // Moves every node of 'other' into this heap and leaves 'other' empty; both heaps
+    // must use the same ordering. The nodes are appended and the order is restored as in
+    // push_bulk(). 'threads' applies to a rebuild.
+    void merge(MaxHeap&& other, unsigned threads = 1) {
+        if (&other == this || other.empty())
+            return;
+        if (heap.empty() && heap.get_allocator() == other.heap.get_allocator()) {
+            heap.swap(other.heap);
+            return;
+        }
+        size_t n = heap.size();
+        heap.insert(heap.end(), make_move_iterator(other.heap.begin()), make_move_iterator(other.heap.end()));
+        other.heap.clear();
+        restoreAppended(n, threads);
+    }
+
+    // Inserts every KVNode of [first, last). The batch is appended first; then each new
+    // node is sifted up, O(m log_d(n + m)), or the whole storage is rebuilt bottom-up,
+    // O(n + m), whichever is cheaper for the batch and heap sizes.
+    template<typename InputIt>
+    void push_bulk(InputIt first, InputIt last) {
+        size_t n = heap.size();
+        heap.insert(heap.end(), first, last);
+        restoreAppended(n, 1);
+    }
+
+    // Inserts every KVNode of 'range'; the nodes are moved out of an rvalue range.
+    template<typename Range>
+    void push_bulk(Range&& range) {
+        if constexpr (is_lvalue_reference<Range>::value)
+            push_bulk(std::begin(range), std::end(range));
+        else
+            push_bulk(make_move_iterator(std::begin(range)), make_move_iterator(std::end(range)));
+    }
+
+    // Removes the top min(k, size()) nodes and writes them to 'out' by move, highest
+    // first; returns how many were written. Each root moves straight into 'out' and the
+    // last node is sifted down into the hole, with no temporary per node.
+    template<typename OutputIt>
+    size_t pop_n(size_t k, OutputIt out) {
+        k = min(k, heap.size());
+        for (size_t i = 0; i < k; i++) {
+            *out++ = std::move(heap[0]);
+            int last = static_cast<int>(heap.size()) - 1;
+            if (last > 0)
+                heapify(heap, 0, last, std::move(heap[last]));
+            heap.pop_back();
+        }
+        return k;
+    }
+};
+
+// Map and heap variants that draw their memory from a std::pmr::memory_resource.
+// Backed by a monotonic_buffer_resource, allocations are pointer bumps and a short-lived
+// frequency table is freed in one step when the resource is released.
+template<typename Key, typename Value, typename Hash = Hash<Key>>
+using PmrUnorderedMap = UnorderedMap<Key, Value, Hash, pmr::polymorphic_allocator<pair<const Key, Value>>>;
+template<typename K, typename V, typename Compare = less<K>>
+using PmrMaxHeap = MaxHeap<K, V, Compare, pmr::polymorphic_allocator<KVNode<K, V>>>;
+
+// Adds one to counts[k - low] for every int32 key k of in[0 .. n) that lies in the window
+// [low, low + range), and calls outside(k) for the others. Returns how many keys were
+// handled, a multiple of 8, or 0 when no vector kernel is compiled in; the caller counts
+// the rest. Each group of 8 keys is offset and tested against the window with one AVX2
+// compare; the increments stay scalar, since scattered adds to repeated keys conflict.
+template<typename F>
+size_t histogramKeys(const int32_t* in, size_t n, int32_t low, size_t range, int* counts, F&& outside) {
+#if defined(__AVX2__)
+    if (range == 0 || range - 1 > numeric_limits<uint32_t>::max())
+        return 0;
+    const __m256i base = _mm256_set1_epi32(low);
+    const __m256i last = _mm256_set1_epi32(static_cast<int32_t>(static_cast<uint32_t>(range - 1)));
+    alignas(32) uint32_t off[8];
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i v = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + j)), base);
+        // Unsigned offset <= range - 1 exactly when the minimum leaves it unchanged.
+        __m256i inside = _mm256_cmpeq_epi32(_mm256_min_epu32(v, last), v);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(off), v);
+        if (mask == 0xff) {
+            for (int l = 0; l < 8; l++)
+                ++counts[off[l]];
+        }
+        else {
+            for (int l = 0; l < 8; l++) {
+                if (mask >> l & 1)
+                    ++counts[off[l]];
+                else
+                    outside(in[j + l]);
+            }
+        }
+    }
+    return j;
+#else
+    (void)in;
+    (void)n;
+    (void)low;
+    (void)range;
+    (void)counts;
+    (void)outside;
+    return 0;
+#endif
+}
+
+// DenseCountMap: a frequency table for integral keys that mostly fall in a small range
+// [low, low + range). Those keys index a plain array of values, with no hashing or
+// probing; any other key goes to an UnorderedMap, so every key is still accepted.
+// A dense slot that holds Value() reads as absent, which suits counting: only keys with
+// a non-zero value are reported. With an empty window it is just the hash map.
+template<typename Key, typename Value>
+class DenseCountMap {
+private:
+    static_assert(is_integral<Key>::value, "DenseCountMap indexes its values by integral keys");
+    using UKey = make_unsigned_t<Key>;
+
+    vector<Value> dense; // dense[i] belongs to key low + i.
+    Key low = 0;
+    UnorderedMap<Key, Value> overflow; // Keys outside the window.
+
+    // Offset of 'key' into the window; dense.size() or more when the key lies outside.
+    size_t offset(Key key) const {
+        return static_cast<size_t>(static_cast<UKey>(static_cast<UKey>(key) - static_cast<UKey>(low)));
+    }
+
+    // Key stored at window offset 'i'.
+    Key keyAt(size_t i) const {
+        return static_cast<Key>(static_cast<UKey>(static_cast<UKey>(low) + i));
+    }
+
+public:
+    // Largest window forSample() and forRange() will allocate.
+    static constexpr size_t maxRange = size_t(1) << 22;
+
+    // Window cap for 'expected' keys to come: a window much larger than that would cost
+    // more to scan than the hash map costs to fill, so it gets at most four slots per
+    // expected key (but at least 2^16 slots), and never more than 'limit'.
+    static size_t windowLimit(size_t expected, size_t limit) {
+        return min(limit, max<size_t>(size_t(1) << 16, expected * 4));
+    }
+
+    // Table whose dense window covers keys [low, low + range); range 0 sends every key
+    // to the hash map.
+    explicit DenseCountMap(Key low = 0, size_t range = 0) : dense(range), low(low) {}
+
+    // Table whose window is chosen from the keys sample[0 .. n): the span of the sample,
+    // widened by a quarter on each side for keys the sample missed, as long as the result
+    // stays within windowLimit(expected, limit) slots, where 'expected' is the number of
+    // keys to come. A sample that fits no window gives a plain hash map.
+    static DenseCountMap forSample(const Key* sample, size_t n, size_t expected, size_t limit = maxRange) {
+        if (n == 0)
+            return DenseCountMap();
+        auto [lo, hi] = minmax_element(sample, sample + n);
+        limit = windowLimit(expected, limit);
+        // Spans are measured in the unsigned type, so they cannot overflow.
+        UKey span = static_cast<UKey>(static_cast<UKey>(*hi) - static_cast<UKey>(*lo));
+        if (span >= limit)
+            return DenseCountMap();
+        // Widen downwards without passing the smallest key, and upwards without passing
+        // the largest one.
+        UKey below = min<UKey>(span / 4, static_cast<UKey>(*lo) - static_cast<UKey>(numeric_limits<Key>::min()));
+        Key start = static_cast<Key>(static_cast<UKey>(static_cast<UKey>(*lo) - below));
+        size_t range = min<size_t>(limit, size_t(span) + 1 + size_t(span) / 2);
+        size_t room = static_cast<UKey>(static_cast<UKey>(numeric_limits<Key>::max()) - static_cast<UKey>(start));
+        return DenseCountMap(start, room < range - 1 ? room + 1 : range);
+    }
+
+    // Table whose window covers the keys [lo, hi] of a caller's range hint, or a plain
+    // hash map when that range is wider than windowLimit(expected, limit) slots.
+    static DenseCountMap forRange(Key lo, Key hi, size_t expected, size_t limit = maxRange) {
+        if (hi < lo)
+            return DenseCountMap();
+        UKey span = static_cast<UKey>(static_cast<UKey>(hi) - static_cast<UKey>(lo));
+        if (span >= windowLimit(expected, limit))
+            return DenseCountMap();
+        return DenseCountMap(lo, size_t(span) + 1);
+    }
+
+    // Access the value for 'key', inserting Value() when the key lies outside the
+    // window and is not yet present.
+    Value& operator[](Key key) {
+        size_t i = offset(key);
+        if (i < dense.size())
+            return dense[i];
+        return overflow[key];
+    }
+
+    // Adds one to the value of every key in in[0 .. n), a histogram of the range.
+    void countAll(const Key* in, size_t n) {
+        countOffsets(in, n, 0, dense.size(), true);
+    }
+
+    // Adds one to the value of every key of in[0 .. n) whose window offset lies in
+    // [from, to), and to every key outside the window when 'outside' is set. Threads may
+    // count disjoint offset ranges of one table at once if at most one of them passes
+    // 'outside'. int keys and values take histogramKeys() when it is compiled in.
+    void countOffsets(const Key* in, size_t n, size_t from, size_t to, bool outside) {
+        if (from == to && !outside)
+            return;
+        Value* counts = dense.data() + from;
+        size_t range = to - from;
+        Key base = keyAt(from);
+        size_t window = dense.size();
+        auto other = [&](Key key) {
+            if (outside && offset(key) >= window)
+                ++overflow[key];
+        };
+        size_t j = 0;
+        if constexpr (is_same<Key, int32_t>::value && is_same<Value, int>::value)
+            j = histogramKeys(in, n, base, range, counts, other);
+        for (; j < n; j++) {
+            size_t i = static_cast<size_t>(static_cast<UKey>(static_cast<UKey>(in[j]) - static_cast<UKey>(base)));
+            if (i < range)
+                ++counts[i];
+            else
+                other(in[j]);
+        }
+    }
+
+    // Adds the values of 'other', which must have the same window, and releases it.
+    void absorb(DenseCountMap&& other) {
+        if (other.low != low || other.dense.size() != dense.size())
+            throw runtime_error("DenseCountMap::absorb: windows differ");
+        for (size_t i = 0; i < dense.size(); i++)
+            dense[i] += other.dense[i];
+        if (overflow.size() < other.overflow.size())
+            swap(overflow, other.overflow);
+        other.overflow.drain([&](Key key, Value value) { overflow[key] += value; });
+        other = DenseCountMap();
+    }
+
+    // Number of keys with a value; scans the whole window.
+    size_t size() const {
+        size_t count = overflow.size();
+        for (const Value& value : dense)
+            count += !(value == Value());
+        return count;
+    }
+
+    // Number of keys the dense window covers.
+    size_t windowSize() const {
+        return dense.size();
+    }
+
+    // Calls f(key, value) for every key with a value: the window in key order, then the
+    // keys outside it.
+    template<typename F>
+    void for_each(F&& f) const {
+        for (size_t i = 0; i < dense.size(); i++) {
+            if (!(dense[i] == Value()))
+                f(keyAt(i), dense[i]);
+        }
+        overflow.for_each(f);
+    }
+
+    // Moves every element out as f(Key&&, Value&&) and leaves the table empty with its
+    // storage released.
+    template<typename F>
+    void drain(F&& f) {
+        for (size_t i = 0; i < dense.size(); i++) {
+            if (!(dense[i] == Value()))
+                f(keyAt(i), std::move(dense[i]));
+        }
+        dense = vector<Value>();
+        overflow.drain(f);
+    }
+
+    // Return all entries as a vector of KVNode for external use.
+    vector<KVNode<Key, Value>> getEntries() const {
+        vector<KVNode<Key, Value>> out;
+        for_each([&](Key key, const Value& value) { out.emplace_back(key, value); });
+        return out;
+    }
+
+    // Return the k entries with the largest values, ordered from largest to smallest,
+    // with the bounded min-heap of UnorderedMap::topK.
+    vector<KVNode<Key, Value>> topK(size_t k) const {
+        MaxHeap<Value, Key, greater<Value>> best;
+        if (k > 0) {
+            for_each([&](Key key, const Value& value) {
+                if (best.size() < k)
+                    best.emplace(value, key);
+                else if (best.top().key < value)
+                    best.replaceTop(KVNode<Value, Key>(value, key));
+            });
+        }
+        vector<KVNode<Value, Key>> sorted = best.drainSorted();
+        vector<KVNode<Key, Value>> out;
+        out.reserve(sorted.size());
+        for (auto& node : sorted)
+            out.emplace_back(std::move(node.value), std::move(node.key));
+        return out;
+    }
+};
+
+// AddressableMaxHeap: a d-ary heap over KVNodes whose entries can be reached after insertion.
+// insert() returns a stable handle; a side table maps each live handle to the node's current
+// position and is kept up to date by every sift, so update() and erase() run in O(log_d n)
+// without leaving stale entries behind. Handles of removed nodes are recycled.
+// Ordering follows MaxHeap: Compare defaults to std::less (max-heap).
+// A handle is only meaningful while its node is in the heap: once the handle has been
+// recycled by a later insert, contains() is true for it again and it refers to the new
+// node, so callers must drop handles of removed nodes.
+template<typename K, typename V, typename Compare = less<K>>
+class AddressableMaxHeap {
+public:
+    using Handle = size_t;
+
+private:
+    // A heap node together with the handle that refers to it.
+    struct Slot {
+        KVNode<K, V> node;
+        Handle handle;
+    };
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    vector<Slot> heap;
+    vector<size_t> position; // Heap index of each handle, npos when the handle is free.
+    vector<Handle> freeHandles; // Handles available for reuse.
+    int d = 2; // d-ary heap (default binary heap)
+    Compare comp; // Key ordering.
+
+    // True when key 'a' belongs above key 'b' in the heap.
+    bool higher(const K& a, const K& b) const {
+        return comp(b, a);
+    }
+
+    // Writes 'slot' at heap index 'i' and records its new position.
+    void place(size_t i, Slot&& slot) {
+        position[slot.handle] = i;
+        heap[i] = std::move(slot);
+    }
+
+    // Heapify up: move the slot at index 'ind' up, shifting lower parents down into the hole.
+    void hUp(size_t ind) {
+        Slot slot = std::move(heap[ind]);
+        while (ind > 0) {
+            size_t parent = (ind - 1) / d;
+            if (!higher(slot.node.key, heap[parent].node.key))
+                break;
+            place(ind, std::move(heap[parent]));
+            ind = parent;
+        }
+        place(ind, std::move(slot));
+    }
+
+    // Heapify down: move the slot at index 'ind' down, shifting higher children up into the hole.
+    void hDown(size_t ind) {
+        Slot slot = std::move(heap[ind]);
+        size_t n = heap.size();
+        for (;;) {
+            size_t first = d * ind + 1;
+            if (first >= n)
+                break;
+            size_t best = first;
+            size_t last = min(first + d, n);
+            for (size_t child = first + 1; child < last; child++) {
+                if (higher(heap[child].node.key, heap[best].node.key))
+                    best = child;
+            }
+            if (!higher(heap[best].node.key, slot.node.key))
+                break;
+            place(ind, std::move(heap[best]));
+            ind = best;
+        }
+        place(ind, std::move(slot));
+    }
+
+    // Restore the heap property for the slot at 'ind' after its key changed either way.
+    void fix(size_t ind) {
+        if (ind > 0 && higher(heap[ind].node.key, heap[(ind - 1) / d].node.key))
+            hUp(ind);
+        else
+            hDown(ind);
+    }
+
+    // Removes the slot at heap index 'ind', frees its handle and returns its node.
+    KVNode<K, V> removeAt(size_t ind) {
+        Slot removed = std::move(heap[ind]);
+        position[removed.handle] = npos;
+        freeHandles.push_back(removed.handle);
+        Slot last = std::move(heap.back());
+        heap.pop_back();
+        if (ind < heap.size()) {
+            place(ind, std::move(last));
+            fix(ind);
+        }
+        return std::move(removed.node);
+    }
+
+public:
+    // Default constructor.
+    AddressableMaxHeap() = default;
+    // Constructor to set the arity 'd' for the heap.
+    AddressableMaxHeap(int d) : d(d) {}
+    // Constructor taking the arity and a comparator instance.
+    AddressableMaxHeap(int d, const Compare& comp) : d(d), comp(comp) {}
+
+    // Insert a node and return a handle that stays valid until the node is removed.
+    Handle insert(KVNode<K, V> node) {
+        Handle h;
+        if (!freeHandles.empty()) {
+            h = freeHandles.back();
+            freeHandles.pop_back();
+        }
+        else {
+            h = position.size();
+            position.push_back(npos);
         }
+        heap.push_back(Slot{ std::move(node), h });
+        hUp(heap.size() - 1);
+        return h;
+    }
+
+    // Construct a node in place from (key, value) and insert it.
+    Handle emplace(K key, V value) {
+        return insert(KVNode<K, V>(std::move(key), std::move(value)));
+    }
+
+    // Check whether 'h' refers to a node in the heap. A recycled handle of a removed node
+    // counts as live again; see the class comment.
+    bool contains(Handle h) const {
+        return h < position.size() && position[h] != npos;
+    }
+
+    // Access the node behind a live handle.
+    const KVNode<K, V>& get(Handle h) const {
+        return heap[position[h]].node;
+    }
+
+    // Change the key of a live handle, moving the node up or down as needed.
+    void update(Handle h, K newKey) {
+        size_t ind = position[h];
+        heap[ind].node.key = std::move(newKey);
+        fix(ind);
+    }
+
+    // Remove the node behind a live handle and return it.
+    KVNode<K, V> erase(Handle h) {
+        return removeAt(position[h]);
+    }
+
+    // Returns the root node. The heap must not be empty.
+    const KVNode<K, V>& top() const {
+        return heap[0].node;
+    }
+
+    // Handle of the root node. The heap must not be empty.
+    Handle topHandle() const {
+        return heap[0].handle;
+    }
+
+    // Removes the root node and returns it by move.
+    KVNode<K, V> pop() {
+        return removeAt(0);
+    }
+
+    // Number of nodes in the heap.
+    size_t size() const {
+        return heap.size();
+    }
+
+    // Check if the heap is empty.
+    bool empty() const {
+        return heap.empty();
     }
 };
 
-// UnorderedMap: a simple hash table implementation using separate chaining.
-template<typename Key, typename Value, typename Hash = Hash<Key>>
-class UnorderedMap {
+// Position of the first maximum among the 'width' int32 keys at 'p', the same child the
+// scalar scan of SoaMaxHeap picks on ties, or -1 when no vector kernel covers 'width'.
+// Groups of 8 take one AVX2 compare, groups of 16 take two.
+inline int argmaxKeys(const int32_t* p, int width) {
+#if defined(__AVX2__)
+    if (width == 8 || width == 16) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hi = width == 16 ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 8)) : lo;
+        // Broadcast the maximum lane to all lanes.
+        __m256i m = _mm256_max_epi32(lo, hi);
+        m = _mm256_max_epi32(m, _mm256_permute2x128_si256(m, m, 1));
+        m = _mm256_max_epi32(m, _mm256_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm256_max_epi32(m, _mm256_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(lo, m))));
+        if (width == 16)
+            mask |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(hi, m)))) << 8;
+        return lowestBit(mask);
+    }
+#endif
+    (void)p;
+    (void)width;
+    return -1;
+}
+
+// SoaMaxHeap: a d-ary heap over key-value pairs stored as a structure of arrays.
+// The heap order lives in a dense key array and a parallel array of 32-bit value ids;
+// the values stay where they were inserted, in a slot array addressed by id. Sifting
+// compares and moves only keys and ids, so a large V is never touched by hDown or hUp
+// and each sibling group is a contiguous run of keys. Slots of popped values are reused.
+// With int keys, the default std::less and d = 8 or 16, full sibling groups are scanned
+// with argmaxKeys(). Ordering and pop order follow MaxHeap.
+template<typename K, typename V, typename Compare = less<K>>
+class SoaMaxHeap {
 private:
-    // Internal node structure for each bucket.
-    struct Node {
-        Key key;
-        Value value;
-    };
-    // Buckets: a vector of vectors of nodes.
-    vector<vector<Node>> buckets;
-    Hash hashFunc; // Hash function object.
-    size_t numElements; // Total number of stored elements.
-    static constexpr float loadFactor = 0.75f; // Threshold for rehashing.
+    using Id = uint32_t;
+    vector<K> keys; // Keys in heap order.
+    vector<Id> ids; // ids[i] is the value slot of the node at heap index i.
+    vector<V> values; // Value slots, addressed by id.
+    vector<Id> freeIds; // Slots of popped values, reused by later inserts.
+    int d = 2; // d-ary heap (default binary heap)
+    Compare comp; // Key ordering.
 
-    // Rehash: doubles the bucket count and redistributes all nodes.
-    void rehash() {
-        size_t newBucketCount = buckets.size() * 2;
-        vector<vector<Node>> newBuckets(newBucketCount);
-        // Move each node to its new bucket.
-        for (auto& bucket : buckets) {
-            for (auto& node : bucket) {
-                size_t newIndex = hashFunc(node.key) % newBucketCount;
-                newBuckets[newIndex].push_back(node);
-            }
-        }
-        buckets = std::move(newBuckets);
+    // True when key 'a' belongs above key 'b' in the heap.
+    bool higher(const K& a, const K& b) const {
+        return comp(b, a);
     }
-public:
-    // Constructor with an optional initial bucket count (default 16).
-    UnorderedMap(size_t bucketCount = 16) : buckets(bucketCount), numElements(0) {}
 
-    // Insert a key-value pair into the map. If key exists, update its value.
-    void insert(const Key& key, const Value& value) {
-        // Rehash if load factor threshold exceeded.
-        if (numElements > buckets.size() * loadFactor)
-            rehash();
-        size_t index = hashFunc(key) % buckets.size();
-        // Check if the key already exists in the bucket.
-        for (auto& node : buckets[index]) {
-            if (node.key == key) {
-                node.value = value;
-                return;
+    // Returns the index of the largest child in the group starting at 'first'.
+    int maxChild(int first, int heapSize) const {
+        int last = min(first + d, heapSize);
+        if constexpr (is_same<K, int32_t>::value && is_same<Compare, less<K>>::value) {
+            if (last - first == d) {
+                int best = argmaxKeys(&keys[first], d);
+                if (best >= 0)
+                    return first + best;
             }
         }
-        // If key not found, add new node.
-        buckets[index].push_back(Node{ key, value });
-        ++numElements;
+        int largest = first;
+        for (int child = first + 1; child < last; child++) {
+            if (higher(keys[child], keys[largest]))
+                largest = child;
+        }
+        return largest;
     }
 
-    // Erase the element with the given key.
-    bool erase(const Key& key) {
-        size_t index = hashFunc(key) % buckets.size();
-        auto& bucket = buckets[index];
-        for (auto it = bucket.begin(); it != bucket.end(); ++it) {
-            if (it->key == key) {
-                bucket.erase(it);
-                --numElements;
-                return true;
-            }
+    // Places ('key', 'id') into the hole at index 'i' and sifts it down within [0, heapSize).
+    // Larger children move up into the hole; the pair is written once at its final position.
+    void hDown(int i, int heapSize, K key, Id id) {
+        for (;;) {
+            int first = d * i + 1;
+            if (first >= heapSize)
+                break;
+            int largest = maxChild(first, heapSize);
+            // Stop once no child is larger than the held key.
+            if (!higher(keys[largest], key))
+                break;
+            keys[i] = std::move(keys[largest]);
+            ids[i] = ids[largest];
+            i = largest;
         }
-        return false;
+        keys[i] = std::move(key);
+        ids[i] = id;
     }
 
-    // Find element by key (non-const version). Returns pointer to value or nullptr.
-    Value* find(const Key& key) {
-        size_t index = hashFunc(key) % buckets.size();
-        for (auto& node : buckets[index]) {
-            if (node.key == key)
-                return &node.value;
+    // Heapify up: moves the pair at index 'ind' up, shifting lower parents down into the hole.
+    void hUp(int ind) {
+        K key = std::move(keys[ind]);
+        Id id = ids[ind];
+        while (ind > 0) {
+            int parent = (ind - 1) / d;
+            if (!higher(key, keys[parent]))
+                break;
+            keys[ind] = std::move(keys[parent]);
+            ids[ind] = ids[parent];
+            ind = parent;
         }
-        return nullptr;
+        keys[ind] = std::move(key);
+        ids[ind] = id;
     }
 
-    // Find element by key (const version).
-    const Value* find(const Key& key) const {
-        size_t index = hashFunc(key) % buckets.size();
-        for (const auto& node : buckets[index]) {
-            if (node.key == key)
-                return &node.value;
+    // Stores 'value' in a free slot and returns its id.
+    Id storeValue(V&& value) {
+        if (!freeIds.empty()) {
+            Id id = freeIds.back();
+            freeIds.pop_back();
+            values[id] = std::move(value);
+            return id;
         }
-        return nullptr;
+        values.push_back(std::move(value));
+        return static_cast<Id>(values.size() - 1);
     }
 
-    // Overload operator[]: if key exists, return reference to its value;
-    // otherwise, insert a default-constructed value and return reference to it.
-    Value& operator[](const Key& key) {
-        size_t index = hashFunc(key) % buckets.size();
-        for (auto& node : buckets[index]) {
-            if (node.key == key)
-                return node.value;
+    // Restore the heap property over the whole key array, bottom-up.
+    void heapifyAll() {
+        int n = static_cast<int>(keys.size());
+        for (int i = (n - 2) / d; n > 1 && i >= 0; i--)
+            hDown(i, n, std::move(keys[i]), ids[i]);
+    }
+
+public:
+    // Default constructor.
+    SoaMaxHeap() = default;
+    // Constructor to set the arity 'd' for the heap.
+    SoaMaxHeap(int d) : d(d) {}
+    // Constructor taking the arity and a comparator instance.
+    SoaMaxHeap(int d, const Compare& comp) : d(d), comp(comp) {}
+
+    // Insert a key-value pair into the heap.
+    void insert(K key, V value) {
+        Id id = storeValue(std::move(value));
+        keys.push_back(std::move(key));
+        ids.push_back(id);
+        hUp(static_cast<int>(keys.size()) - 1);
+    }
+
+    // Insert a KVNode into the heap.
+    void insert(KVNode<K, V> node) {
+        insert(std::move(node.key), std::move(node.value));
+    }
+
+    // Key of the root node. The heap must not be empty.
+    const K& topKey() const {
+        return keys[0];
+    }
+
+    // Value of the root node. The heap must not be empty.
+    const V& topValue() const {
+        return values[ids[0]];
+    }
+
+    // Replace the root with ('key', 'value') and restore the heap property with a single
+    // sift. The root's value slot is reused. The heap must not be empty.
+    void replaceTop(K key, V value) {
+        Id id = ids[0];
+        values[id] = std::move(value);
+        hDown(0, static_cast<int>(keys.size()), std::move(key), id);
+    }
+
+    // Removes the root node and returns it by move.
+    KVNode<K, V> pop() {
+        KVNode<K, V> top(std::move(keys[0]), std::move(values[ids[0]]));
+        freeIds.push_back(ids[0]);
+        K lastKey = std::move(keys.back());
+        Id lastId = ids.back();
+        keys.pop_back();
+        ids.pop_back();
+        if (!keys.empty()) {
+            hDown(0, static_cast<int>(keys.size()), std::move(lastKey), lastId);
         }
-        // If rehashing is needed, perform it and recalculate the index.
-        if (numElements > buckets.size() * loadFactor) {
-            rehash();
-            index = hashFunc(key) % buckets.size();
+        else {
+            values.clear();
+            freeIds.clear();
         }
-        buckets[index].push_back(Node{ key, Value() });
-        ++numElements;
-        return buckets[index].back().value;
+        return top;
     }
 
-    // Return all entries as a vector of KVNode for external use.
-    vector<KVNode<Key, Value>> getEntries() {
-        vector<KVNode<Key, Value>> out;
-        for (const auto& bucket : buckets) {
-            for (const auto& node : bucket) {
-                out.push_back(KVNode<Key, Value>(node.key, node.value));
-            }
+    // Number of nodes in the heap.
+    size_t size() const {
+        return keys.size();
+    }
+
+    // Check if the heap is empty.
+    bool empty() const {
+        return keys.empty();
+    }
+
+    // Build the heap from an unsorted array of KVNodes, moving the nodes in.
+    // Value slots are numbered in input order, so building touches each value once.
+    void build(vector<KVNode<K, V>>&& arr) {
+        keys.clear();
+        ids.clear();
+        values.clear();
+        freeIds.clear();
+        keys.reserve(arr.size());
+        ids.reserve(arr.size());
+        values.reserve(arr.size());
+        for (auto& node : arr) {
+            keys.push_back(std::move(node.key));
+            ids.push_back(static_cast<Id>(values.size()));
+            values.push_back(std::move(node.value));
         }
-        return out;
+        arr = vector<KVNode<K, V>>();
+        heapifyAll();
+    }
+
+    // Build the heap from a copy of an unsorted array of KVNodes.
+    void build(const vector<KVNode<K, V>>& arr) {
+        build(vector<KVNode<K, V>>(arr));
+    }
+
+    // Sort the heap in place and move it out as nodes in the order of
+    // MaxHeap::drainSorted(), leaving the heap empty. The sort moves only keys and ids;
+    // every value is moved once, into the output.
+    vector<KVNode<K, V>> drainSorted() {
+        for (int i = static_cast<int>(keys.size()) - 1; i > 0; i--) {
+            K lastKey = std::move(keys[i]);
+            Id lastId = ids[i];
+            keys[i] = std::move(keys[0]);
+            ids[i] = ids[0];
+            hDown(0, i, std::move(lastKey), lastId);
+        }
+        vector<KVNode<K, V>> sorted;
+        sorted.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); i++)
+            sorted.emplace_back(std::move(keys[i]), std::move(values[ids[i]]));
+        keys.clear();
+        ids.clear();
+        values.clear();
+        freeIds.clear();
+        return sorted;
     }
 };
 
-// MaxHeap: a d-ary max heap implementation using KVNode for storage.
-template<typename K, typename V>
-class MaxHeap {
+// IntReader: a fast reader for whitespace-separated integers.
+// Reads a stream through a large buffer with fread, or maps a whole file into
+// memory when a path is given (POSIX only; other platforms read it buffered).
+class IntReader {
 private:
-    // The heap is stored as a vector of KVNode objects.
-    vector<KVNode<K, V>> heap;
-    int d = 2; // d-ary heap (default binary heap)
+    FILE* file = nullptr;
+    bool ownsFile = false;
+    vector<char> buffer;
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    void* mapped = nullptr;
+    size_t mappedSize = 0;
+    static constexpr size_t bufferSize = 1 << 20;
 
-    // Swap two nodes.
-    void swapNodes(KVNode<K, V>& a, KVNode<K, V>& b) {
-        KVNode<K, V> tmp = a;
-        a = b;
-        b = tmp;
+    // Refill the buffer from the file. Returns false at end of input.
+    bool refill() {
+        if (!file)
+            return false;
+        size_t got = fread(buffer.data(), 1, buffer.size(), file);
+        pos = buffer.data();
+        end = pos + got;
+        return got > 0;
     }
 
-    // Heapify down: ensures max-heap property from index 'ind' downward.
-    void hDown(int ind) {
-        int maxIdx = ind;
-        // Check all d children.
-        for (int i = 1; i <= d; i++) {
-            int child = d * ind + i;
-            if (child < heap.size() && heap[child].key > heap[maxIdx].key)
-                maxIdx = child;
+    // Returns the next character without consuming it, or -1 at end of input.
+    int peek() {
+        if (pos == end && !refill())
+            return -1;
+        return static_cast<unsigned char>(*pos);
+    }
+
+public:
+    // Read from an already open stream (e.g. stdin).
+    explicit IntReader(FILE* stream) : file(stream), buffer(bufferSize) {}
+
+    // Read from the file at 'path', memory-mapping it where supported.
+    explicit IntReader(const char* path) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                mapped = p;
+                mappedSize = st.st_size;
+                pos = static_cast<const char*>(p);
+                end = pos + mappedSize;
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+        if (mapped)
+            return;
+#endif
+        file = fopen(path, "rb");
+        if (!file)
+            throw runtime_error(string("cannot open ") + path);
+        ownsFile = true;
+        buffer.resize(bufferSize);
+    }
+
+    IntReader(const IntReader&) = delete;
+    IntReader& operator=(const IntReader&) = delete;
+
+    ~IntReader() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapped)
+            munmap(mapped, mappedSize);
+#endif
+        if (ownsFile)
+            fclose(file);
+    }
+
+    // Parse the next integer into 'out'. Returns false at end of input. Tokens are
+    // separated by whitespace and hold an optional sign and at least one digit; throws
+    // runtime_error on any other token, or one that does not fit in T.
+    template<typename T>
+    bool next(T& out) {
+        static_assert(is_integral<T>::value, "IntReader parses integers");
+        // Digits accumulate in the unsigned type, whose range holds the magnitude of
+        // numeric_limits<T>::min() as well.
+        using U = make_unsigned_t<T>;
+        int c = peek();
+        // Skip whitespace.
+        while (c != -1 && isspace(c)) {
+            ++pos;
+            c = peek();
         }
-        // If a larger child is found, swap and continue heapifying down.
-        if (maxIdx != ind) {
-            swapNodes(heap[ind], heap[maxIdx]);
-            hDown(maxIdx);
+        if (c == -1)
+            return false;
+        bool negative = c == '-';
+        if (negative || c == '+') {
+            ++pos;
+            c = peek();
         }
+        if (c < '0' || c > '9')
+            throw runtime_error("IntReader: expected an integer");
+        U limit = static_cast<U>(numeric_limits<T>::max());
+        if (negative)
+            limit = is_signed<T>::value ? static_cast<U>(limit + 1) : 0;
+        U value = 0;
+        while (c >= '0' && c <= '9') {
+            U digit = static_cast<U>(c - '0');
+            if (digit > limit || value > static_cast<U>(limit - digit) / 10)
+                throw runtime_error("IntReader: integer out of range");
+            value = static_cast<U>(value * 10 + digit);
+            ++pos;
+            c = peek();
+        }
+        if (c != -1 && !isspace(c))
+            throw runtime_error("IntReader: expected an integer");
+        out = static_cast<T>(negative ? static_cast<U>(U(0) - value) : value);
+        return true;
     }
+};
 
-    // Heapify up: move the element at index 'ind' up to restore heap property.
-    void hUp(int ind) {
-        if (ind == 0)
+// IntWriter: buffered output for integers. Values are formatted with to_chars into a
+// large buffer that is written out with a few big fwrite calls. In binary mode the
+// raw native-endian bytes of each value are written instead, with no separators.
+class IntWriter {
+private:
+    FILE* file;
+    bool binary;
+    vector<char> buffer;
+    size_t used = 0;
+    static constexpr size_t bufferSize = 1 << 16;
+    // Room kept free for one formatted value plus its separator.
+    static constexpr size_t maxItem = 32;
+
+public:
+    explicit IntWriter(FILE* stream, bool binary = false) : file(stream), binary(binary), buffer(bufferSize) {}
+
+    IntWriter(const IntWriter&) = delete;
+    IntWriter& operator=(const IntWriter&) = delete;
+
+    ~IntWriter() {
+        flush();
+    }
+
+    // Write out everything buffered so far.
+    void flush() {
+        if (used > 0)
+            fwrite(buffer.data(), 1, used, file);
+        used = 0;
+        fflush(file);
+    }
+
+    // Append 'value' followed by 'separator' (text mode), or its raw bytes (binary mode).
+    template<typename T>
+    void write(T value, char separator) {
+        static_assert(is_integral<T>::value && sizeof(T) <= 8, "IntWriter writes integers of up to 64 bits");
+        if (buffer.size() - used < maxItem)
+            flush();
+        if (binary) {
+            memcpy(buffer.data() + used, &value, sizeof(T));
+            used += sizeof(T);
             return;
-        int parent = (ind - 1) / d;
-        if (heap[ind].key > heap[parent].key) {
-            swapNodes(heap[ind], heap[parent]);
-            hUp(parent);
         }
+        char* out = to_chars(buffer.data() + used, buffer.data() + buffer.size(), value).ptr;
+        *out++ = separator;
+        used = out - buffer.data();
     }
+};
 
-    // Heapify helper for heapSort: maintains heap property for array 'arr' up to heapSize.
-    void heapify(vector<KVNode<K, V>>& arr, int i, int heapSize) {
-        int largest = i;
-        for (int j = 1; j <= d; j++) {
-            int child = d * i + j;
-            if (child < heapSize && arr[child].key > arr[largest].key)
-                largest = child;
-        }
-        if (largest != i) {
-            swapNodes(arr[i], arr[largest]);
-            heapify(arr, largest, heapSize);
+// Adds the counts of 'src' into 'dst' and releases 'src'.
+// The smaller map is folded into the larger one; its keys are moved out with drain().
+template<typename T>
+void mergeCounts(UnorderedMap<T, int>& dst, UnorderedMap<T, int>& src) {
+    if (dst.size() < src.size())
+        swap(dst, src);
+    src.drain([&](T&& key, int count) { dst[std::move(key)] += count; });
+}
+
+// Number of distinct keys to reserve a counting table for, when the first 'sampled' of
+// 'total' values held 'distinct' keys. Reserving for every value would clear a table
+// sized for the whole input even when it repeats a few keys, so the reservation follows
+// the sample: exact when the sample is the whole input, twice the keys seen when the
+// sample repeats keys, and up to distinctReserveCap when it repeats none. The table
+// grows past that as needed.
+constexpr size_t distinctReserveCap = size_t(1) << 20;
+
+inline size_t distinctReserve(size_t distinct, size_t sampled, size_t total) {
+    if (sampled >= total)
+        return distinct;
+    if (distinct == sampled)
+        return min(total, max(2 * distinct, distinctReserveCap));
+    return min(total, 2 * distinct);
+}
+
+// First values of each input slice that are counted before its table is reserved.
+constexpr size_t distinctSampleSize = 4096;
+
+// Counts in[begin, end) into 'mp': the first distinctSampleSize values are counted,
+// the table is reserved from the keys they held, and the rest follow.
+template<typename T>
+void countSlice(UnorderedMap<T, int>& mp, const vector<T>& in, size_t begin, size_t end) {
+    size_t split = min(end, begin + distinctSampleSize);
+    for (size_t i = begin; i < split; i++)
+        mp[in[i]]++;
+    mp.reserve(distinctReserve(mp.size(), split - begin, end - begin));
+    for (size_t i = split; i < end; i++)
+        mp[in[i]]++;
+}
+
+// Counts how often each value occurs in 'in' using 'threads' worker threads.
+// Each thread counts its slice of the input into a thread-local map; the partial
+// maps are then merged pairwise in a parallel tree of log2(threads) rounds.
+template<typename T>
+UnorderedMap<T, int> countFrequencies(const vector<T>& in, unsigned threads) {
+    if (threads <= 1) {
+        UnorderedMap<T, int> mp;
+        countSlice(mp, in, 0, in.size());
+        return mp;
+    }
+    vector<UnorderedMap<T, int>> partial(threads);
+    vector<thread> workers;
+    size_t chunk = (in.size() + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            size_t begin = min(in.size(), t * chunk);
+            size_t end = min(in.size(), begin + chunk);
+            countSlice(partial[t], in, begin, end);
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    // Tree merge: in each round, map t absorbs map t + stride.
+    for (size_t stride = 1; stride < threads; stride *= 2) {
+        workers.clear();
+        for (size_t t = 0; t + stride < threads; t += 2 * stride)
+            workers.emplace_back([&, t, stride] { mergeCounts(partial[t], partial[t + stride]); });
+        for (auto& w : workers)
+            w.join();
+    }
+    return std::move(partial[0]);
+}
+
+// Largest number of counters the per-thread copies of a dense window may add up to.
+constexpr size_t denseCopyBudget = size_t(1) << 22;
+
+// Counts 'in' into the empty table 'table' using 'threads' threads. While the window
+// fits denseCopyBudget once per thread, each thread histograms its slice of the input
+// into a copy of the table and the copies are summed pairwise as in the hash map
+// version. A larger window is split instead: every thread scans the whole input and
+// counts the keys of its own part of the window into the shared table, and the first
+// thread also counts the keys outside the window.
+template<typename T>
+DenseCountMap<T, int> countFrequencies(const vector<T>& in, DenseCountMap<T, int> table, unsigned threads) {
+    threads = max(threads, 1u);
+    size_t window = table.windowSize();
+    if (threads == 1) {
+        table.countAll(in.data(), in.size());
+        return table;
+    }
+    vector<thread> workers;
+    if (threads * window > denseCopyBudget) {
+        size_t part = (window + threads - 1) / threads;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                size_t from = min(window, t * part);
+                size_t to = min(window, from + part);
+                table.countOffsets(in.data(), in.size(), from, to, t == 0);
+            });
         }
+        for (auto& w : workers)
+            w.join();
+        return table;
+    }
+    vector<DenseCountMap<T, int>> partial(threads, table);
+    table = DenseCountMap<T, int>();
+    size_t chunk = (in.size() + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            size_t begin = min(in.size(), t * chunk);
+            size_t end = min(in.size(), begin + chunk);
+            partial[t].countAll(in.data() + begin, end - begin);
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    for (size_t stride = 1; stride < threads; stride *= 2) {
+        workers.clear();
+        for (size_t t = 0; t + stride < threads; t += 2 * stride)
+            workers.emplace_back([&, t, stride] { partial[t].absorb(std::move(partial[t + stride])); });
+        for (auto& w : workers)
+            w.join();
+    }
+    return std::move(partial[0]);
+}
+
+// A sorted run of KVNodes consumed front to back by mergeRuns(). The run either sits in
+// memory as a whole or was spilled to a temporary file and is read back in blocks.
+template<typename K, typename V>
+class SortedRun {
+private:
+    vector<KVNode<K, V>> block; // Current block; the whole run when held in memory.
+    size_t count = 0; // Valid nodes in 'block'.
+    size_t pos = 0; // Next node of 'block'.
+    FILE* file = nullptr; // Spill file the remaining blocks come from, or null.
+    static constexpr size_t blockEntries = 1 << 16;
+
+    // Reads the next block from the spill file. Returns false once the file is exhausted.
+    bool refill() {
+        if (!file)
+            return false;
+        if (block.size() < blockEntries)
+            block.assign(blockEntries, KVNode<K, V>(K(), V()));
+        count = fread(block.data(), sizeof(KVNode<K, V>), blockEntries, file);
+        pos = 0;
+        return count > 0;
     }
 
 public:
-    // Default constructor.
-    MaxHeap() = default;
-    // Constructor to set the arity 'd' for the heap.
-    MaxHeap(int d) : d(d) {}
+    // A run held in memory; 'nodes' must be sorted.
+    explicit SortedRun(vector<KVNode<K, V>>&& nodes) : block(std::move(nodes)) {
+        count = block.size();
+    }
 
-    // Insert a KVNode into the heap.
-    void insert(const KVNode<K, V>& value) {
-        heap.push_back(value);
-        hUp(heap.size() - 1);
+    // A run read back from the spill file 'f', positioned at its start. The run owns the
+    // file; a temporary file is removed when it is closed.
+    static SortedRun fromFile(FILE* f) {
+        SortedRun run{ vector<KVNode<K, V>>() };
+        run.file = f;
+        return run;
     }
 
-    // Returns a constant reference to the internal heap vector.
-    const vector<KVNode<K, V>>& getHeap() const {
-        return heap;
+    SortedRun(SortedRun&& other) noexcept
+        : block(std::move(other.block)), count(other.count), pos(other.pos), file(other.file) {
+        other.file = nullptr;
+        other.count = other.pos = 0;
     }
+    SortedRun(const SortedRun&) = delete;
+    SortedRun& operator=(const SortedRun&) = delete;
 
-    // Returns the maximum value (at the root of the heap).
-    V getMax() const {
-        return heap[0].value;
+    ~SortedRun() {
+        if (file)
+            fclose(file);
     }
 
-    // Extracts and removes the maximum element from the heap.
-    V extractMax() {
-        V maxVal = heap[0].value;
-        heap[0] = heap.back();
-        heap.pop_back();
-        if (!heap.empty())
-            hDown(0);
-        return maxVal;
+    // True once every node has been taken.
+    bool done() {
+        return pos == count && !refill();
     }
 
-    // Build the heap from an unsorted array of KVNodes.
-    void build(const vector<KVNode<K, V>>& arr) {
-        heap = arr;
-        int start = (heap.size() - 1) / d;
-        for (int i = start; i >= 0; i--)
-            hDown(i);
+    // Key of the next node. The run must not be done.
+    const K& key() const {
+        return block[pos].key;
     }
 
-    // Check if the heap is empty.
-    bool empty() {
-        return heap.empty();
+    // Removes and returns the next node. The run must not be done.
+    KVNode<K, V> take() {
+        return std::move(block[pos++]);
     }
+};
 
-    // Perform heap sort and return a vector of sorted values.
-    vector<V> heapSort() {
-        // Create a copy of the heap.
-        vector<KVNode<K, V>> arr = heap;
-        int n = arr.size();
-        // Build a max heap from the array.
-        for (int i = (n - 1) / d; i >= 0; i--) {
-            heapify(arr, i, n);
-        }
-        // Extract elements one by one.
-        for (int i = n - 1; i > 0; i--) {
-            swapNodes(arr[0], arr[i]);
-            heapify(arr, 0, i);
+// RunWriter: writes a sorted run to a temporary file in blocks of raw bytes.
+// finish() hands the file over to a SortedRun that reads it back.
+template<typename K, typename V>
+class RunWriter {
+private:
+    static_assert(is_trivially_copyable<KVNode<K, V>>::value, "spilled runs are written as raw bytes");
+    FILE* file;
+    vector<KVNode<K, V>> block;
+    static constexpr size_t blockEntries = 1 << 16;
+
+    // Writes 'count' nodes to the file.
+    void writeNodes(const KVNode<K, V>* nodes, size_t count) {
+        if (fwrite(nodes, sizeof(KVNode<K, V>), count, file) != count)
+            throw runtime_error("cannot write a sorted run");
+    }
+
+public:
+    RunWriter() : file(tmpfile()) {
+        if (!file)
+            throw runtime_error("cannot create a temporary file for a sorted run");
+        block.reserve(blockEntries);
+    }
+    RunWriter(const RunWriter&) = delete;
+    RunWriter& operator=(const RunWriter&) = delete;
+    ~RunWriter() {
+        if (file)
+            fclose(file);
+    }
+
+    // Appends one node; nodes must arrive in sorted order.
+    void put(const KVNode<K, V>& node) {
+        block.push_back(node);
+        if (block.size() == blockEntries) {
+            writeNodes(block.data(), block.size());
+            block.clear();
         }
-        // Extract the sorted values.
-        vector<V> sorted;
-        for (const auto& node : arr) {
-            sorted.push_back(node.value);
+    }
+
+    // Appends a sorted array of nodes.
+    void put(const vector<KVNode<K, V>>& nodes) {
+        writeNodes(block.data(), block.size());
+        block.clear();
+        writeNodes(nodes.data(), nodes.size());
+    }
+
+    // Flushes the file and returns it as a run.
+    SortedRun<K, V> finish() {
+        writeNodes(block.data(), block.size());
+        block.clear();
+        if (fflush(file) != 0)
+            throw runtime_error("cannot write a sorted run");
+        rewind(file);
+        FILE* f = file;
+        file = nullptr;
+        return SortedRun<K, V>::fromFile(f);
+    }
+};
+
+// Merges sorted runs into one ascending sequence, handing each node to out(node).
+// A d-ary min-heap over the run heads acts as the tournament: the root names the run
+// with the smallest next key, and after that node is taken the root is replaced by
+// the run's following key with a single sift. Ties go to the lower run index, so equal
+// keys leave in run order: stable runs over consecutive slices of the input merge stably.
+template<typename K, typename V, typename F>
+void mergeRuns(vector<SortedRun<K, V>>& runs, F&& out) {
+    using Head = pair<K, size_t>; // Next key of a run and the run index.
+    MaxHeap<Head, size_t, greater<Head>> tournament(4);
+    for (size_t r = 0; r < runs.size(); r++) {
+        if (!runs[r].done())
+            tournament.emplace(Head(runs[r].key(), r), r);
+    }
+    while (!tournament.empty()) {
+        size_t r = tournament.top().value;
+        out(runs[r].take());
+        if (runs[r].done())
+            tournament.pop();
+        else
+            tournament.replaceTop(KVNode<Head, size_t>(Head(runs[r].key(), r), r));
+    }
+}
+
+// Sorts entries by key in ascending order, the order MaxHeap::drainSorted() produces.
+// With threads > 1 the entries are split into one chunk per thread, each chunk is
+// heap-sorted on its own thread, and the sorted chunks are merged by mergeRuns().
+template<typename K, typename V>
+vector<KVNode<K, V>> heapSortEntries(vector<KVNode<K, V>>&& entries, unsigned threads) {
+    if (threads <= 1 || entries.size() < 2 * static_cast<size_t>(threads)) {
+        MaxHeap<K, V> heap;
+        heap.build(std::move(entries));
+        return heap.drainSorted();
+    }
+    size_t n = entries.size();
+    size_t chunk = (n + threads - 1) / threads;
+    vector<vector<KVNode<K, V>>> chunks;
+    for (size_t lo = 0; lo < n; lo += chunk) {
+        auto first = entries.begin() + lo;
+        auto last = entries.begin() + min(n, lo + chunk);
+        chunks.emplace_back(make_move_iterator(first), make_move_iterator(last));
+    }
+    entries = vector<KVNode<K, V>>();
+    parallelFor(0, chunks.size(), threads, [&](size_t c) {
+        MaxHeap<K, V> heap;
+        heap.build(std::move(chunks[c]));
+        chunks[c] = heap.drainSorted();
+    });
+    vector<SortedRun<K, V>> runs;
+    for (auto& c : chunks)
+        runs.emplace_back(std::move(c));
+    vector<KVNode<K, V>> sorted;
+    sorted.reserve(n);
+    mergeRuns(runs, [&](KVNode<K, V>&& node) { sorted.push_back(std::move(node)); });
+    return sorted;
+}
+
+// Integral key types sortEntries() orders with counting or radix sort instead of a heap.
+template<typename K>
+constexpr bool radixSortable = is_integral<K>::value && !is_same<K, bool>::value;
+
+// Largest key range countingSortByKey() is used for; a wider range takes the radix passes.
+constexpr size_t countingSortRange = size_t(1) << 16;
+
+// Order-preserving unsigned image of an integral key: the sign bit of signed keys is
+// flipped, so negative keys come first.
+template<typename K>
+make_unsigned_t<K> radixKey(K key) {
+    using U = make_unsigned_t<K>;
+    U u = static_cast<U>(key);
+    if (is_signed<K>::value)
+        u ^= U(1) << (numeric_limits<U>::digits - 1);
+    return u;
+}
+
+// Stable counting sort by key. Every radixKey() must lie in [low, low + range).
+template<typename K, typename V>
+vector<KVNode<K, V>> countingSortByKey(vector<KVNode<K, V>>&& entries, make_unsigned_t<K> low, size_t range) {
+    vector<size_t> start(range + 1, 0);
+    for (const auto& node : entries)
+        start[static_cast<size_t>(radixKey(node.key) - low) + 1]++;
+    for (size_t i = 1; i <= range; i++)
+        start[i] += start[i - 1];
+    vector<KVNode<K, V>> sorted(entries.size(), KVNode<K, V>(K(), V()));
+    for (auto& node : entries)
+        sorted[start[static_cast<size_t>(radixKey(node.key) - low)]++] = std::move(node);
+    return sorted;
+}
+
+// Stable LSD radix sort by key, one byte per pass. The histograms of all bytes are
+// taken in a single pass over the input, and a byte that is the same for every key
+// (e.g. the high bytes of small frequencies) skips its scatter pass.
+template<typename K, typename V>
+vector<KVNode<K, V>> radixSortByKey(vector<KVNode<K, V>>&& entries) {
+    using U = make_unsigned_t<K>;
+    constexpr size_t bytes = sizeof(U);
+    size_t n = entries.size();
+    if (n < 2)
+        return std::move(entries);
+    vector<size_t> counts(bytes * 256, 0);
+    for (const auto& node : entries) {
+        U u = radixKey(node.key);
+        for (size_t b = 0; b < bytes; b++)
+            counts[b * 256 + ((u >> (8 * b)) & 0xFF)]++;
+    }
+    vector<KVNode<K, V>> buffer;
+    for (size_t b = 0; b < bytes; b++) {
+        size_t* count = &counts[b * 256];
+        if (count[(radixKey(entries[0].key) >> (8 * b)) & 0xFF] == n)
+            continue;
+        if (buffer.empty())
+            buffer.assign(n, KVNode<K, V>(K(), V()));
+        size_t sum = 0;
+        for (size_t d = 0; d < 256; d++) {
+            size_t c = count[d];
+            count[d] = sum;
+            sum += c;
         }
-        return sorted;
+        for (auto& node : entries)
+            buffer[count[(radixKey(node.key) >> (8 * b)) & 0xFF]++] = std::move(node);
+        entries.swap(buffer);
+    }
+    return std::move(entries);
+}
+
+// Sorts entries by key in ascending order. Integral keys are placed in O(n): a counting
+// sort when the keys span at most countingSortRange values (the usual case for
+// frequencies), LSD radix passes otherwise. Both are stable, so equal keys keep their
+// input order. Other keys go through heapSortEntries().
+template<typename K, typename V>
+vector<KVNode<K, V>> sortEntries(vector<KVNode<K, V>>&& entries, unsigned threads) {
+    if constexpr (radixSortable<K>) {
+        if (entries.size() < 2)
+            return std::move(entries);
+        using U = make_unsigned_t<K>;
+        U low = numeric_limits<U>::max(), high = 0;
+        for (const auto& node : entries) {
+            U u = radixKey(node.key);
+            low = min(low, u);
+            high = max(high, u);
+        }
+        if (high - low < countingSortRange)
+            return countingSortByKey(std::move(entries), low, static_cast<size_t>(high - low) + 1);
+        return radixSortByKey(std::move(entries));
+    }
+    else {
+        return heapSortEntries(std::move(entries), threads);
+    }
+}
+
+// RunSorter: sorts a stream of KVNodes by key in ascending order within a memory budget.
+// add() buffers up to 'maxBuffered' nodes; a full buffer is sorted with sortEntries()
+// and spilled to a temporary file as one sorted run. finish() merges the spilled runs
+// and the last buffer, so only one block per run is in memory during the merge.
+// Spilled runs are kept in levels: once 'fanIn' runs share a level they are merged into
+// one run of the next level, which bounds the number of open files by fanIn per level.
+// K and V must be trivially copyable.
+template<typename K, typename V>
+class RunSorter {
+private:
+    vector<KVNode<K, V>> buffer;
+    vector<vector<SortedRun<K, V>>> levels;
+    size_t maxBuffered;
+    unsigned threads;
+    static constexpr size_t fanIn = 64;
+
+    // Adds a spilled run at 'level', merging the level into the next one when it is full.
+    void addRun(SortedRun<K, V>&& run, size_t level) {
+        if (levels.size() <= level)
+            levels.resize(level + 1);
+        levels[level].push_back(std::move(run));
+        if (levels[level].size() < fanIn)
+            return;
+        RunWriter<K, V> writer;
+        mergeRuns(levels[level], [&](KVNode<K, V>&& node) { writer.put(node); });
+        levels[level].clear();
+        addRun(writer.finish(), level + 1);
+    }
+
+    // Sorts the buffer and writes it out as a spilled run.
+    void spill() {
+        RunWriter<K, V> writer;
+        writer.put(sortEntries(std::move(buffer), threads));
+        buffer = vector<KVNode<K, V>>();
+        addRun(writer.finish(), 0);
+    }
+
+public:
+    // 'maxBuffered' nodes are kept in memory before a run is spilled; sorting a buffer
+    // uses 'threads' threads.
+    explicit RunSorter(size_t maxBuffered, unsigned threads = 1)
+        : maxBuffered(max<size_t>(1, maxBuffered)), threads(threads) {}
+
+    // Adds a node; may spill a run.
+    void add(KVNode<K, V> node) {
+        buffer.push_back(std::move(node));
+        if (buffer.size() >= maxBuffered)
+            spill();
+    }
+
+    // Number of spilled runs currently waiting to be merged.
+    size_t spilledRuns() const {
+        size_t count = 0;
+        for (const auto& level : levels)
+            count += level.size();
+        return count;
+    }
+
+    // Hands every added node to out(node) in ascending key order; the sorter is empty afterwards.
+    // With integral keys equal keys keep the order they were added in: higher levels hold
+    // older nodes, so the runs are merged from the top level down.
+    template<typename F>
+    void finish(F&& out) {
+        vector<SortedRun<K, V>> runs;
+        for (size_t level = levels.size(); level-- > 0;) {
+            for (auto& run : levels[level])
+                runs.push_back(std::move(run));
+        }
+        levels.clear();
+        if (!buffer.empty())
+            runs.emplace_back(sortEntries(std::move(buffer), threads));
+        buffer = vector<KVNode<K, V>>();
+        mergeRuns(runs, out);
     }
 };
 
-int main() {
-    int n;
-    // Read number of elements.
-    cin >> n;
-    
-    // Create an unordered map to count frequencies.
-    UnorderedMap<int, int> mp;
-    vector<int> in(n);
-    // Read input numbers and increment their count.
-    for (int i = 0; i < n; i++) {
-        cin >> in[i];
-        mp[in[i]]++;
+// The program entry point can be left out (HEAP_NO_MAIN) to reuse the
+// containers above, e.g. from the benchmark suite.
+#ifndef HEAP_NO_MAIN
+// Sort key that orders (count, value) entries by count, then by value. Counts are
+// positive ints, so the key is non-negative and the value's order-preserving unsigned
+// image fills the low half.
+inline int64_t frequencyKey(int count, int value) {
+    return static_cast<int64_t>((static_cast<uint64_t>(count) << 32) | radixKey(value));
+}
+
+// Writes the values of 'table' (an UnorderedMap or a DenseCountMap from value to count)
+// ordered by frequency, or only the 'topCount' most frequent ones when it is non-zero.
+// Equal frequencies are ordered by value, so the output does not depend on the table or
+// the thread count: the full listing ascends by (count, value), and the top-k listing is
+// its last k values in reverse. The table is emptied.
+template<typename Table>
+void writeByFrequency(Table& table, IntWriter& writer, size_t topCount, size_t sortMemoryMiB, unsigned threads) {
+    // Top-k query: bounded selection instead of sorting every distinct value. The
+    // min-heap keeps the k largest keys, as in UnorderedMap::topK().
+    if (topCount > 0) {
+        MaxHeap<int64_t, int, greater<int64_t>> best;
+        table.for_each([&](int value, int count) {
+            int64_t key = frequencyKey(count, value);
+            if (best.size() < topCount)
+                best.emplace(key, value);
+            else if (best.top().key < key)
+                best.replaceTop(KVNode<int64_t, int>(key, value));
+        });
+        for (const auto& node : best.drainSorted())
+            writer.write(node.value, '\n');
+        return;
     }
     
-    // Get all key-value entries from the map.
-    vector<KVNode<int, int>> entries = mp.getEntries();
-    // Swap key and value for heap usage (e.g., frequency as key).
-    for (int i = 0; i < entries.size(); i++) {
-        swap(entries[i].key, entries[i].value);
+    // External sort: the entries stream from the table into bounded buffers, which are
+    // spilled as sorted runs and merged on output. Entries are keyed by frequencyKey().
+    if (sortMemoryMiB > 0) {
+        RunSorter<int64_t, int> sorter((sortMemoryMiB << 20) / sizeof(KVNode<int64_t, int>), threads);
+        table.drain([&](int value, int count) { sorter.add(KVNode<int64_t, int>(frequencyKey(count, value), value)); });
+        sorter.finish([&](const KVNode<int64_t, int>& node) { writer.write(node.value, '\n'); });
+        return;
     }
     
-    // Build a max heap from the entries.
-    MaxHeap<int, int> mh;
-    mh.build(entries);
+    // Move the entries out of the table, which releases its storage. They are sorted by
+    // value first, so that the stable sort by frequency leaves equal frequencies in
+    // value order.
+    vector<KVNode<int, int>> entries;
+    entries.reserve(table.size());
+    table.drain([&](int value, int count) { entries.emplace_back(value, count); });
+    entries = sortEntries(std::move(entries), threads);
+    // Key by frequency for sorting (key and value swap places).
+    for (auto& node : entries)
+        swap(node.key, node.value);
     
-    // Perform heap sort on the heap.
-    vector<int> sorted = mh.heapSort();
+    // Order the entries by frequency; integral frequencies take the counting sort path.
+    vector<KVNode<int, int>> sorted = sortEntries(std::move(entries), threads);
     // Output sorted values.
-    for (auto x : sorted)
-        cout << x << endl;
-    
+    for (const auto& node : sorted)
+        writer.write(node.value, '\n');
+}
+
+// Usage: Sorting_by_frequency [-t threads] [-k count] [-i file] [-b] [-m MiB] [-s file] [-l file]
+//                             [-r low:high] < input
+// -t sets the number of counting and sorting threads (default 1, 0 = all hardware threads).
+// -k prints only the k most frequent values, most frequent first.
+// -i reads the input from a (memory-mapped) file instead of stdin.
+// -b writes the values as raw native-endian 32-bit integers instead of text.
+// -m limits the sort stage to that many MiB of entries; the rest is spilled to
+//    temporary files as sorted runs and merged back while writing the output.
+// -s saves the frequency table to a snapshot file after counting.
+// -l loads the frequency table from a snapshot file instead of reading any input.
+// -r hints that the values mostly lie in [low, high], so they are counted in a
+//    direct-indexed table; values outside the range are still counted. A range wider
+//    than DenseCountMap::windowLimit() allows for the input is ignored.
+// Without -r the table is chosen from the input: when the first values read (or, with
+// several threads, all of them) span a small range, a DenseCountMap replaces the hash map.
+// Snapshots hold hash tables, so -s and -l always count with the hash map.
+int main(int argc, char* argv[]) {
+    unsigned threads = 1;
+    size_t topCount = 0;
+    size_t sortMemoryMiB = 0;
+    const char* inputPath = nullptr;
+    const char* savePath = nullptr;
+    const char* loadPath = nullptr;
+    bool binaryOutput = false;
+    bool rangeHint = false;
+    long long hintLow = 0, hintHigh = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if ((arg == "-t" || arg == "--threads") && i + 1 < argc)
+            threads = static_cast<unsigned>(stoul(argv[++i]));
+        else if ((arg == "-k" || arg == "--top") && i + 1 < argc)
+            topCount = stoul(argv[++i]);
+        else if ((arg == "-i" || arg == "--input") && i + 1 < argc)
+            inputPath = argv[++i];
+        else if (arg == "-b" || arg == "--binary")
+            binaryOutput = true;
+        else if ((arg == "-m" || arg == "--memory") && i + 1 < argc)
+            sortMemoryMiB = stoul(argv[++i]);
+        else if ((arg == "-s" || arg == "--save") && i + 1 < argc)
+            savePath = argv[++i];
+        else if ((arg == "-l" || arg == "--load") && i + 1 < argc)
+            loadPath = argv[++i];
+        else if ((arg == "-r" || arg == "--range") && i + 1 < argc) {
+            string range = argv[++i];
+            size_t colon = range.find(':');
+            if (colon == string::npos)
+                throw runtime_error("-r expects low:high");
+            hintLow = stoll(range.substr(0, colon));
+            hintHigh = stoll(range.substr(colon + 1));
+            if (hintLow > hintHigh || hintLow < numeric_limits<int>::min() || hintHigh > numeric_limits<int>::max())
+                throw runtime_error("-r expects low:high with low <= high in the int range");
+            rangeHint = true;
+        }
+    }
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    IntWriter writer(stdout, binaryOutput);
+
+    if (loadPath) {
+        // Warm start: the table comes back from its snapshot without any counting.
+        UnorderedMap<int, int> mp = UnorderedMap<int, int>::loadSnapshot(loadPath);
+        if (savePath)
+            mp.saveSnapshot(savePath);
+        writeByFrequency(mp, writer, topCount, sortMemoryMiB, threads);
+        return 0;
+    }
+
+    IntReader reader = inputPath ? IntReader(inputPath) : IntReader(stdin);
+    int n = 0;
+    // Read number of elements.
+    reader.next(n);
+    size_t expected = static_cast<size_t>(max(n, 0));
+    bool denseAllowed = savePath == nullptr;
+    // The window given by -r for 'count' values, if any; a range too wide for the input
+    // falls back to the hash map.
+    auto hinted = [&](size_t count) {
+        return DenseCountMap<int, int>::forRange(static_cast<int>(hintLow), static_cast<int>(hintHigh), count);
+    };
+
+    if (threads <= 1) {
+        // Streaming mode: count values as they are parsed, without storing the input.
+        // The first values form the sample that picks the table.
+        vector<int> sample;
+        sample.reserve(min(expected, distinctSampleSize));
+        int x;
+        int read = 0;
+        for (; read < n && sample.size() < distinctSampleSize && reader.next(x); read++)
+            sample.push_back(x);
+        DenseCountMap<int, int> dense;
+        if (denseAllowed)
+            dense = rangeHint ? hinted(expected) : DenseCountMap<int, int>::forSample(sample.data(), sample.size(), expected);
+        if (dense.windowSize() > 0) {
+            dense.countAll(sample.data(), sample.size());
+            for (; read < n && reader.next(x); read++)
+                ++dense[x];
+            writeByFrequency(dense, writer, topCount, sortMemoryMiB, threads);
+            return 0;
+        }
+        // The table is reserved from the keys of the sample, so counting rarely rehashes
+        // without clearing a table sized for every value of a repetitive input.
+        UnorderedMap<int, int> mp;
+        for (int v : sample)
+            mp[v]++;
+        mp.reserve(distinctReserve(mp.size(), sample.size(), expected));
+        for (; read < n && reader.next(x); read++)
+            mp[x]++;
+        if (savePath)
+            mp.saveSnapshot(savePath);
+        writeByFrequency(mp, writer, topCount, sortMemoryMiB, threads);
+        return 0;
+    }
+
+    // Parallel mode: the input is split across threads, so it is read up front, and the
+    // whole of it decides whether a dense window fits.
+    vector<int> in;
+    in.reserve(expected);
+    int x;
+    for (int i = 0; i < n && reader.next(x); i++)
+        in.push_back(x);
+    DenseCountMap<int, int> dense;
+    if (denseAllowed)
+        dense = rangeHint ? hinted(in.size()) : DenseCountMap<int, int>::forSample(in.data(), in.size(), in.size());
+    if (dense.windowSize() > 0) {
+        DenseCountMap<int, int> counts = countFrequencies(in, std::move(dense), threads);
+        in = vector<int>();
+        writeByFrequency(counts, writer, topCount, sortMemoryMiB, threads);
+        return 0;
+    }
+    UnorderedMap<int, int> mp = countFrequencies(in, threads);
+    in = vector<int>();
+    if (savePath)
+        mp.saveSnapshot(savePath);
+    writeByFrequency(mp, writer, topCount, sortMemoryMiB, threads);
     return 0;
 }
+#endif
@@ -0,0 +1,354 @@
+// Benchmarks for the d-ary MaxHeap<T, D> in D-ary_heap.cpp.
+#include "D-ary_heap.cpp"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <mutex>
+
+// Largest heap size benchmarked for numeric and string payloads.
+#ifndef HEAP_BENCH_MAX_SIZE
+#define HEAP_BENCH_MAX_SIZE 100000000
+#endif
+#ifndef HEAP_BENCH_MAX_STRING_SIZE
+#define HEAP_BENCH_MAX_STRING_SIZE 1000000
+#endif
+
+namespace {
+
+// Random payload generators.
+template<typename T>
+T makeValue(mt19937_64& rng) {
+    return static_cast<T>(rng());
+}
+
+template<>
+string makeValue<string>(mt19937_64& rng) {
+    // 24 characters: long enough to defeat the small-string optimization.
+    string s(24, 'a');
+    for (char& c : s)
+        c = static_cast<char>('a' + rng() % 26);
+    return s;
+}
+
+// Returns n random values. The last generated input is cached between benchmarks.
+template<typename T>
+const vector<T>& input(size_t n) {
+    static vector<T> cached;
+    if (cached.size() != n) {
+        mt19937_64 rng(42);
+        cached.clear();
+        cached.shrink_to_fit();
+        cached.reserve(n);
+        for (size_t i = 0; i < n; i++)
+            cached.push_back(makeValue<T>(rng));
+    }
+    return cached;
+}
+
+// Inserts n values one by one into a heap with compile-time arity D
+// (D == 0: runtime arity taken from the second argument). 'Aligned' selects
+// the cache-aligned, prefetching layout.
+template<typename T, int D, bool Aligned = false>
+void BM_Insert(benchmark::State& state) {
+    const vector<T>& in = input<T>(state.range(0));
+    int d = D > 0 ? D : static_cast<int>(state.range(1));
+    for (auto _ : state) {
+        MaxHeap<T, D, less<T>, Aligned> mh(d);
+        for (const T& x : in)
+            mh.insert(x);
+        benchmark::DoNotOptimize(mh.data());
+    }
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+
+// Builds a heap from n unsorted values (bottom-up heapify). The copy of the
+// input is excluded from the timing.
+template<typename T, int D, bool Aligned = false>
+void BM_Build(benchmark::State& state) {
+    const vector<T>& in = input<T>(state.range(0));
+    int d = D > 0 ? D : static_cast<int>(state.range(1));
+    for (auto _ : state) {
+        state.PauseTiming();
+        vector<T> arr = in;
+        MaxHeap<T, D, less<T>, Aligned> mh(d);
+        state.ResumeTiming();
+        mh.build(std::move(arr));
+        benchmark::DoNotOptimize(mh.data());
+    }
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+
+// Parallel build of n values with range(1) threads; wall time, since the work is spread.
+template<typename T, int D>
+void BM_BuildParallel(benchmark::State& state) {
+    const vector<T>& in = input<T>(state.range(0));
+    unsigned threads = static_cast<unsigned>(state.range(1));
+    for (auto _ : state) {
+        state.PauseTiming();
+        vector<T> arr = in;
+        MaxHeap<T, D> mh;
+        state.ResumeTiming();
+        mh.build(std::move(arr), threads);
+        benchmark::DoNotOptimize(mh.data());
+    }
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+
+// Pops every element of a heap built from n values.
+template<typename T, int D, bool Aligned = false>
+void BM_PopAll(benchmark::State& state) {
+    const vector<T>& in = input<T>(state.range(0));
+    int d = D > 0 ? D : static_cast<int>(state.range(1));
+    for (auto _ : state) {
+        state.PauseTiming();
+        MaxHeap<T, D, less<T>, Aligned> mh(d);
+        mh.build(vector<T>(in));
+        state.ResumeTiming();
+        while (!mh.empty())
+            benchmark::DoNotOptimize(mh.pop());
+    }
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+
+// Ways of combining a heap of range(1) values into one of range(0) values.
+enum class Combine { InsertLoop, Merge, Pairing };
+
+// Combines two heaps built from random ints; only the combining step is timed.
+template<Combine how>
+void BM_Merge(benchmark::State& state) {
+    const vector<int>& in = input<int>(state.range(0) + state.range(1));
+    vector<int> first(in.begin(), in.begin() + state.range(0));
+    vector<int> second(in.begin() + state.range(0), in.end());
+    for (auto _ : state) {
+        state.PauseTiming();
+        if constexpr (how == Combine::Pairing) {
+            PairingMaxHeap<int> a, b;
+            a.build(first);
+            b.build(second);
+            state.ResumeTiming();
+            a.merge(std::move(b));
+            benchmark::DoNotOptimize(a.top());
+            state.PauseTiming();
+        }
+        else {
+            MaxHeap<int, 4> a, b;
+            a.build(first);
+            b.build(second);
+            state.ResumeTiming();
+            if constexpr (how == Combine::Merge) {
+                a.merge(std::move(b));
+            }
+            else {
+                while (!b.empty())
+                    a.insert(b.pop());
+            }
+            benchmark::DoNotOptimize(a.data());
+            state.PauseTiming();
+        }
+        // The heaps are freed outside the timed region.
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * second.size());
+}
+
+// Pops every element of a pairing heap built from n values, the price of its O(1) merge.
+void BM_PairingPopAll(benchmark::State& state) {
+    const vector<int>& in = input<int>(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        PairingMaxHeap<int> heap;
+        heap.build(in);
+        state.ResumeTiming();
+        while (!heap.empty())
+            benchmark::DoNotOptimize(heap.pop());
+    }
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+
+// One tick on a heap of range(0) ints: push a batch of range(1) values, then pop as
+// many, either one at a time (false) or with push_bulk() and pop_n() (true).
+template<bool batched>
+void BM_Tick(benchmark::State& state) {
+    const vector<int>& in = input<int>(state.range(0) + state.range(1));
+    vector<int> batch(in.begin() + state.range(0), in.end());
+    MaxHeap<int, 4> mh;
+    mh.build(vector<int>(in.begin(), in.begin() + state.range(0)));
+    vector<int> out(batch.size());
+    for (auto _ : state) {
+        if (batched) {
+            mh.push_bulk(batch);
+            mh.pop_n(batch.size(), out.begin());
+        }
+        else {
+            for (int x : batch)
+                mh.insert(x);
+            for (int& x : out)
+                x = mh.pop();
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+
+// Elements preloaded into the shared queues before the concurrent benchmarks start.
+constexpr int sharedPrefill = 1 << 16;
+
+MultiQueue<int, 4>* sharedMultiQueue = nullptr;
+
+// MultiQueue throughput: every thread alternates push and try_pop on one shared queue.
+void BM_MultiQueue(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        sharedMultiQueue = new MultiQueue<int, 4>(state.threads());
+        for (int i = 0; i < sharedPrefill; i++)
+            sharedMultiQueue->push(i * 7919);
+    }
+    mt19937 rng(state.thread_index());
+    for (auto _ : state) {
+        sharedMultiQueue->push(static_cast<int>(rng()));
+        int out;
+        benchmark::DoNotOptimize(sharedMultiQueue->try_pop(out));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+    if (state.thread_index() == 0) {
+        delete sharedMultiQueue;
+        sharedMultiQueue = nullptr;
+    }
+}
+
+mutex sharedHeapLock;
+MaxHeap<int, 4>* sharedHeap = nullptr;
+
+// Baseline for BM_MultiQueue: one MaxHeap behind a global mutex.
+void BM_LockedHeap(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        sharedHeap = new MaxHeap<int, 4>();
+        for (int i = 0; i < sharedPrefill; i++)
+            sharedHeap->insert(i * 7919);
+    }
+    mt19937 rng(state.thread_index());
+    for (auto _ : state) {
+        lock_guard<mutex> guard(sharedHeapLock);
+        sharedHeap->insert(static_cast<int>(rng()));
+        benchmark::DoNotOptimize(sharedHeap->pop());
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+    if (state.thread_index() == 0) {
+        delete sharedHeap;
+        sharedHeap = nullptr;
+    }
+}
+
+// Size sweep 1K..max for the fixed-arity heaps.
+void sizes(benchmark::internal::Benchmark* b, int64_t maxSize) {
+    b->RangeMultiplier(10)->Range(1000, maxSize)->Unit(benchmark::kMillisecond);
+}
+
+// Size sweep crossed with the runtime arities.
+void runtimeSizes(benchmark::internal::Benchmark* b, int64_t maxSize) {
+    for (int64_t d : { 2, 3, 4, 8, 16 }) {
+        for (int64_t n = 1000; n <= maxSize; n *= 10)
+            b->Args({ n, d });
+    }
+    b->Unit(benchmark::kMillisecond);
+}
+
+// Large sizes crossed with thread counts for the parallel build.
+void parallelBuildSizes(benchmark::internal::Benchmark* b) {
+    for (int64_t threads : { 1, 2, 4, 8, 16 }) {
+        for (int64_t n = 1000000; n <= HEAP_BENCH_MAX_SIZE; n *= 10)
+            b->Args({ n, threads });
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+// Heap sizes crossed with the size of the heap merged into them. The untimed builds
+// dominate each iteration, so the iteration count is fixed rather than derived from
+// the (possibly tiny) timed part.
+void mergeSizes(benchmark::internal::Benchmark* b) {
+    for (int64_t n = 1000; n <= 10000000; n *= 10) {
+        for (int64_t m : { n / 1000, n / 10, n })
+            b->Args({ n, max<int64_t>(m, 1) });
+    }
+    b->Iterations(20)->Unit(benchmark::kMicrosecond);
+}
+
+// Heap sizes crossed with per-tick batch sizes.
+void tickSizes(benchmark::internal::Benchmark* b) {
+    for (int64_t n : { 10000, 1000000 }) {
+        for (int64_t m : { 16, 1024, 65536, 1000000 })
+            b->Args({ n, m });
+    }
+    b->Unit(benchmark::kMicrosecond);
+}
+
+void numericSizes(benchmark::internal::Benchmark* b) {
+    sizes(b, HEAP_BENCH_MAX_SIZE);
+}
+void numericRuntimeSizes(benchmark::internal::Benchmark* b) {
+    runtimeSizes(b, HEAP_BENCH_MAX_SIZE);
+}
+void stringSizes(benchmark::internal::Benchmark* b) {
+    sizes(b, HEAP_BENCH_MAX_STRING_SIZE);
+}
+void stringRuntimeSizes(benchmark::internal::Benchmark* b) {
+    runtimeSizes(b, HEAP_BENCH_MAX_STRING_SIZE);
+}
+
+} // namespace
+
+// Registers insert / build / pop benchmarks for one payload type and the tested arities.
+#define HEAP_BENCHMARKS(T, SIZES, RUNTIME_SIZES)              \
+    BENCHMARK(BM_Insert<T, 2>)->Apply(SIZES);                 \
+    BENCHMARK(BM_Insert<T, 3>)->Apply(SIZES);                 \
+    BENCHMARK(BM_Insert<T, 4>)->Apply(SIZES);                 \
+    BENCHMARK(BM_Insert<T, 8>)->Apply(SIZES);                 \
+    BENCHMARK(BM_Insert<T, 16>)->Apply(SIZES);                \
+    BENCHMARK(BM_Insert<T, 0>)->Apply(RUNTIME_SIZES);         \
+    BENCHMARK(BM_Build<T, 2>)->Apply(SIZES);                  \
+    BENCHMARK(BM_Build<T, 3>)->Apply(SIZES);                  \
+    BENCHMARK(BM_Build<T, 4>)->Apply(SIZES);                  \
+    BENCHMARK(BM_Build<T, 8>)->Apply(SIZES);                  \
+    BENCHMARK(BM_Build<T, 16>)->Apply(SIZES);                 \
+    BENCHMARK(BM_Build<T, 0>)->Apply(RUNTIME_SIZES);          \
+    BENCHMARK(BM_PopAll<T, 4>)->Apply(SIZES);                 \
+    BENCHMARK(BM_PopAll<T, 0>)->Apply(RUNTIME_SIZES)
+
+// Cache-aligned layout for the arities whose sibling groups fit cache lines.
+#define ALIGNED_HEAP_BENCHMARKS(T, SIZES)                     \
+    BENCHMARK(BM_Insert<T, 4, true>)->Apply(SIZES);           \
+    BENCHMARK(BM_Insert<T, 8, true>)->Apply(SIZES);           \
+    BENCHMARK(BM_Insert<T, 16, true>)->Apply(SIZES);          \
+    BENCHMARK(BM_Build<T, 4, true>)->Apply(SIZES);            \
+    BENCHMARK(BM_Build<T, 8, true>)->Apply(SIZES);            \
+    BENCHMARK(BM_Build<T, 16, true>)->Apply(SIZES);           \
+    BENCHMARK(BM_PopAll<T, 4, true>)->Apply(SIZES);           \
+    BENCHMARK(BM_PopAll<T, 8, true>)->Apply(SIZES);           \
+    BENCHMARK(BM_PopAll<T, 8>)->Apply(SIZES);                 \
+    BENCHMARK(BM_PopAll<T, 16, true>)->Apply(SIZES);          \
+    BENCHMARK(BM_PopAll<T, 16>)->Apply(SIZES)
+
+HEAP_BENCHMARKS(int, numericSizes, numericRuntimeSizes);
+HEAP_BENCHMARKS(int64_t, numericSizes, numericRuntimeSizes);
+HEAP_BENCHMARKS(string, stringSizes, stringRuntimeSizes);
+ALIGNED_HEAP_BENCHMARKS(int, numericSizes);
+ALIGNED_HEAP_BENCHMARKS(int64_t, numericSizes);
+
+BENCHMARK(BM_BuildParallel<int, 2>)->Apply(parallelBuildSizes);
+BENCHMARK(BM_BuildParallel<int, 4>)->Apply(parallelBuildSizes);
+BENCHMARK(BM_BuildParallel<int, 8>)->Apply(parallelBuildSizes);
+
+BENCHMARK(BM_Merge<Combine::InsertLoop>)->Apply(mergeSizes);
+BENCHMARK(BM_Merge<Combine::Merge>)->Apply(mergeSizes);
+BENCHMARK(BM_Merge<Combine::Pairing>)->Apply(mergeSizes);
+BENCHMARK(BM_PairingPopAll)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_Tick<false>)->Apply(tickSizes);
+BENCHMARK(BM_Tick<true>)->Apply(tickSizes);
+
+BENCHMARK(BM_MultiQueue)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_LockedHeap)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,530 @@
+// Benchmarks for the KVNode MaxHeap and UnorderedMap in Sorting_by_frequency.cpp.
+#include "Sorting_by_frequency.cpp"
+
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#ifndef HEAP_BENCH_MAX_SIZE
+#define HEAP_BENCH_MAX_SIZE 100000000
+#endif
+// Largest key space for the hash map benchmarks.
+#ifndef MAP_BENCH_MAX_KEYS
+#define MAP_BENCH_MAX_KEYS 10000000
+#endif
+
+namespace {
+
+// Number of lookups per iteration in the find benchmarks.
+constexpr size_t lookupsPerIteration = 1 << 20;
+
+// Key distributions for the map benchmarks.
+enum class Dist { Uniform, Zipf, Strided };
+
+// Spacing of Strided keys, like IDs that are multiples of a block size.
+constexpr int keyStride = 128;
+
+// Draws 'count' keys in [0, keySpace) from the given distribution.
+// Zipf uses exponent 1.0 and maps rank r to a scrambled key so that hot keys
+// are spread over the table rather than clustered at small integers.
+// Strided draws uniformly and multiplies by keyStride, so the low bits are all zero.
+vector<int> drawKeys(Dist dist, size_t keySpace, size_t count, uint64_t seed) {
+    mt19937_64 rng(seed);
+    vector<int> keys;
+    keys.reserve(count);
+    if (dist != Dist::Zipf) {
+        uniform_int_distribution<int> pick(0, static_cast<int>(keySpace) - 1);
+        int scale = dist == Dist::Strided ? keyStride : 1;
+        for (size_t i = 0; i < count; i++)
+            keys.push_back(pick(rng) * scale);
+        return keys;
+    }
+    vector<double> cdf(keySpace);
+    double sum = 0;
+    for (size_t r = 0; r < keySpace; r++) {
+        sum += 1.0 / static_cast<double>(r + 1);
+        cdf[r] = sum;
+    }
+    uniform_real_distribution<double> pick(0, sum);
+    for (size_t i = 0; i < count; i++) {
+        size_t rank = lower_bound(cdf.begin(), cdf.end(), pick(rng)) - cdf.begin();
+        rank = min(rank, keySpace - 1);
+        keys.push_back(static_cast<int>((rank * 2654435761ULL) % keySpace));
+    }
+    return keys;
+}
+
+// Random KVNode entries with keys drawn from [0, n).
+vector<KVNode<int, int>> makeEntries(size_t n) {
+    mt19937_64 rng(7);
+    vector<KVNode<int, int>> entries;
+    entries.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        entries.emplace_back(static_cast<int>(rng() % n), static_cast<int>(i));
+    return entries;
+}
+
+// Drains a heap of n nodes with extractMax().
+void BM_KVExtractMax(benchmark::State& state) {
+    vector<KVNode<int, int>> entries = makeEntries(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        MaxHeap<int, int> mh;
+        mh.build(entries);
+        state.ResumeTiming();
+        while (!mh.empty())
+            benchmark::DoNotOptimize(mh.extractMax());
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+// Non-consuming heapSort() of a heap of n nodes.
+void BM_KVHeapSort(benchmark::State& state) {
+    vector<KVNode<int, int>> entries = makeEntries(state.range(0));
+    MaxHeap<int, int> mh;
+    mh.build(entries);
+    for (auto _ : state) {
+        vector<int> sorted = mh.heapSort();
+        benchmark::DoNotOptimize(sorted.data());
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+// Pops the top 1024 nodes of a heap of n nodes and puts them back, either with
+// extractMax() and insert() per node (false) or with pop_n() and push_bulk() (true).
+template<bool batched>
+void BM_KVTopBatch(benchmark::State& state) {
+    vector<KVNode<int, int>> entries = makeEntries(state.range(0));
+    MaxHeap<int, int> mh;
+    mh.build(entries);
+    vector<KVNode<int, int>> out;
+    out.reserve(1024);
+    for (auto _ : state) {
+        out.clear();
+        if (batched) {
+            mh.pop_n(1024, back_inserter(out));
+            mh.push_bulk(out);
+        }
+        else {
+            for (int i = 0; i < 1024 && !mh.empty(); i++) {
+                int key = mh.top().key;
+                out.emplace_back(key, mh.extractMax());
+            }
+            for (const auto& node : out)
+                mh.insert(node);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * out.size());
+}
+
+// Sorts a heap of n nodes in place with drainSorted().
+void BM_KVDrainSorted(benchmark::State& state) {
+    vector<KVNode<int, int>> entries = makeEntries(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        MaxHeap<int, int> mh;
+        mh.build(entries);
+        state.ResumeTiming();
+        vector<KVNode<int, int>> sorted = mh.drainSorted();
+        benchmark::DoNotOptimize(sorted.data());
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+// Heap-sorts n entries with heapSortEntries() on state.range(1) threads.
+void BM_HeapSortEntries(benchmark::State& state) {
+    vector<KVNode<int, int>> entries = makeEntries(state.range(0));
+    unsigned threads = static_cast<unsigned>(state.range(1));
+    for (auto _ : state) {
+        state.PauseTiming();
+        vector<KVNode<int, int>> input = entries;
+        state.ResumeTiming();
+        vector<KVNode<int, int>> sorted = heapSortEntries(std::move(input), threads);
+        benchmark::DoNotOptimize(sorted.data());
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+// Sorts n entries with keys in [0, state.range(1)) through sortEntries(), which takes
+// the counting sort up to countingSortRange distinct keys and radix passes above.
+void BM_SortEntries(benchmark::State& state) {
+    size_t n = state.range(0);
+    mt19937_64 rng(9);
+    vector<KVNode<int, int>> entries;
+    entries.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        entries.emplace_back(static_cast<int>(rng() % state.range(1)), static_cast<int>(i));
+    for (auto _ : state) {
+        state.PauseTiming();
+        vector<KVNode<int, int>> input = entries;
+        state.ResumeTiming();
+        vector<KVNode<int, int>> sorted = sortEntries(std::move(input), 1);
+        benchmark::DoNotOptimize(sorted.data());
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+// Sorts n entries through a RunSorter buffering state.range(1) nodes, so the
+// input is spilled as about n / state.range(1) runs and merged back.
+void BM_RunSorterSpill(benchmark::State& state) {
+    vector<KVNode<int, int>> entries = makeEntries(state.range(0));
+    for (auto _ : state) {
+        RunSorter<int, int> sorter(state.range(1));
+        for (const auto& node : entries)
+            sorter.add(node);
+        int64_t sum = 0;
+        sorter.finish([&](KVNode<int, int>&& node) { sum += node.key; });
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+// A 64-byte value, one cache line per node payload.
+struct Payload {
+    int64_t words[8];
+};
+
+// Heaps of arity 8 over int keys and Payload values, in node and in key-array layout.
+using PayloadHeap = MaxHeap<int, Payload>;
+using SoaPayloadHeap = SoaMaxHeap<int, Payload>;
+
+// Builds a heap of n nodes with Payload values and pops every node.
+template<typename Heap>
+void BM_PayloadDrain(benchmark::State& state) {
+    size_t n = state.range(0);
+    mt19937_64 rng(10);
+    vector<KVNode<int, Payload>> entries;
+    entries.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        entries.emplace_back(static_cast<int>(rng() % n), Payload{ { static_cast<int64_t>(i) } });
+    for (auto _ : state) {
+        state.PauseTiming();
+        vector<KVNode<int, Payload>> input = entries;
+        state.ResumeTiming();
+        Heap heap(8);
+        heap.build(std::move(input));
+        int64_t sum = 0;
+        while (!heap.empty())
+            sum += heap.pop().value.words[0];
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Random priority changes through handles on an addressable heap of n nodes.
+void BM_AddressableUpdate(benchmark::State& state) {
+    size_t n = state.range(0);
+    mt19937_64 rng(8);
+    AddressableMaxHeap<int, int> heap;
+    vector<AddressableMaxHeap<int, int>::Handle> handles;
+    handles.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        handles.push_back(heap.emplace(static_cast<int>(rng() % n), static_cast<int>(i)));
+    for (auto _ : state) {
+        size_t i = rng() % n;
+        heap.update(handles[i], static_cast<int>(rng() % n));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Inserts keySpace keys drawn from the distribution into an empty map.
+template<Dist dist>
+void BM_MapInsert(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    vector<int> keys = drawKeys(dist, keySpace, keySpace, 1);
+    for (auto _ : state) {
+        UnorderedMap<int, int> mp;
+        for (size_t i = 0; i < keys.size(); i++)
+            mp.insert(keys[i], static_cast<int>(i));
+        benchmark::DoNotOptimize(mp.size());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// BM_MapInsert through insert_range(), which sizes the table once for the whole range.
+template<Dist dist>
+void BM_MapInsertRange(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    vector<int> keys = drawKeys(dist, keySpace, keySpace, 1);
+    vector<pair<int, int>> entries;
+    entries.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+        entries.emplace_back(keys[i], static_cast<int>(i));
+    for (auto _ : state) {
+        UnorderedMap<int, int> mp;
+        mp.insert_range(entries.begin(), entries.end());
+        benchmark::DoNotOptimize(mp.size());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Inserts keySpace distinct keys and reports the slowest single insert as max_ns.
+// With incremental rehash the resizes are spread out, so max_ns stays flat as the map grows.
+template<bool incremental>
+void BM_MapInsertMaxLatency(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    double maxNs = 0;
+    for (auto _ : state) {
+        UnorderedMap<int, int> mp;
+        mp.setIncrementalRehash(incremental);
+        for (size_t i = 0; i < keySpace; i++) {
+            auto start = chrono::steady_clock::now();
+            mp.insert(static_cast<int>(i), 1);
+            chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+            maxNs = max(maxNs, elapsed.count());
+        }
+        benchmark::DoNotOptimize(mp.size());
+    }
+    state.counters["max_ns"] = maxNs;
+    state.SetItemsProcessed(state.iterations() * keySpace);
+}
+
+// Frequency counting as in main: operator[] increments over keySpace draws.
+template<Dist dist>
+void BM_MapCount(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    vector<int> keys = drawKeys(dist, keySpace, keySpace, 2);
+    for (auto _ : state) {
+        UnorderedMap<int, int> mp;
+        for (int k : keys)
+            mp[k]++;
+        benchmark::DoNotOptimize(mp.size());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// BM_MapCount through DenseCountMap, whose window is picked from the first draws as in
+// main; keys the window misses fall back to its hash map.
+template<Dist dist>
+void BM_DenseCount(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    vector<int> keys = drawKeys(dist, keySpace, keySpace, 2);
+    size_t sample = min<size_t>(keys.size(), 4096);
+    for (auto _ : state) {
+        auto counts = DenseCountMap<int, int>::forSample(keys.data(), sample, keys.size());
+        counts.countAll(keys.data(), keys.size());
+        benchmark::DoNotOptimize(counts.windowSize());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// BM_MapCount with the table drawn from a monotonic arena that is released per iteration,
+// as for short-lived per-request frequency tables.
+template<Dist dist>
+void BM_MapCountArena(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    vector<int> keys = drawKeys(dist, keySpace, keySpace, 2);
+    pmr::monotonic_buffer_resource arena;
+    for (auto _ : state) {
+        {
+            PmrUnorderedMap<int, int> mp(&arena);
+            for (int k : keys)
+                mp[k]++;
+            benchmark::DoNotOptimize(mp.size());
+        }
+        arena.release();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// BM_MapCount over string keys ("key-<n>"), which exercises the string hash.
+template<Dist dist>
+void BM_MapCountString(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    vector<string> keys;
+    for (int k : drawKeys(dist, keySpace, keySpace, 2))
+        keys.push_back("key-" + to_string(k));
+    for (auto _ : state) {
+        UnorderedMap<string, int> mp;
+        for (const string& k : keys)
+            mp[k]++;
+        benchmark::DoNotOptimize(mp.size());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Lookups of keys that are present; the map holds every key of the key space.
+template<Dist dist>
+void BM_MapFindHit(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    UnorderedMap<int, int> mp;
+    for (size_t k = 0; k < keySpace; k++)
+        mp.insert(static_cast<int>(k), 1);
+    vector<int> keys = drawKeys(dist, keySpace, lookupsPerIteration, 3);
+    for (auto _ : state) {
+        for (int k : keys)
+            benchmark::DoNotOptimize(mp.find(k));
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Visits every node of a map holding n keys through its iterators.
+void BM_MapIterate(benchmark::State& state) {
+    size_t n = state.range(0);
+    UnorderedMap<int, int> mp;
+    for (size_t k = 0; k < n; k++)
+        mp.insert(static_cast<int>(k), 1);
+    for (auto _ : state) {
+        int64_t sum = 0;
+        for (const auto& node : mp)
+            sum += node.value;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Frequency pipeline hand-off: entries keyed by count, either copied out with
+// getEntries() and swapped (false) or moved out with drain() (true).
+template<bool drain>
+void BM_MapToEntries(benchmark::State& state) {
+    size_t n = state.range(0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        UnorderedMap<int, int> mp;
+        for (size_t k = 0; k < n; k++)
+            mp.insert(static_cast<int>(k), 1);
+        state.ResumeTiming();
+        vector<KVNode<int, int>> entries;
+        if (drain) {
+            entries.reserve(mp.size());
+            mp.drain([&](int value, int count) { entries.emplace_back(count, value); });
+        }
+        else {
+            entries = mp.getEntries();
+            mp = UnorderedMap<int, int>();
+            for (auto& entry : entries)
+                swap(entry.key, entry.value);
+        }
+        benchmark::DoNotOptimize(entries.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Warm start of a frequency table with n keys: load it back from a snapshot file.
+void BM_MapSnapshotLoad(benchmark::State& state) {
+    size_t n = state.range(0);
+    const char* path = "bench_map.snap";
+    {
+        UnorderedMap<int, int> mp;
+        for (size_t k = 0; k < n; k++)
+            mp.insert(static_cast<int>(k), 1);
+        mp.saveSnapshot(path);
+    }
+    for (auto _ : state) {
+        UnorderedMap<int, int> mp = UnorderedMap<int, int>::loadSnapshot(path);
+        benchmark::DoNotOptimize(mp.find(0));
+    }
+    std::remove(path);
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Lookups of keys that are absent: the map holds [0, keySpace), lookups are shifted past it.
+template<Dist dist>
+void BM_MapFindMiss(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    UnorderedMap<int, int> mp;
+    for (size_t k = 0; k < keySpace; k++)
+        mp.insert(static_cast<int>(k), 1);
+    vector<int> keys = drawKeys(dist, keySpace, lookupsPerIteration, 4);
+    for (int& k : keys)
+        k += static_cast<int>(keySpace);
+    for (auto _ : state) {
+        for (int k : keys)
+            benchmark::DoNotOptimize(mp.find(k));
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Erases keys drawn from the distribution from a map holding the whole key space.
+template<Dist dist>
+void BM_MapErase(benchmark::State& state) {
+    size_t keySpace = state.range(0);
+    vector<int> keys = drawKeys(dist, keySpace, keySpace, 5);
+    for (auto _ : state) {
+        state.PauseTiming();
+        UnorderedMap<int, int> mp;
+        for (size_t k = 0; k < keySpace; k++)
+            mp.insert(static_cast<int>(k), 1);
+        state.ResumeTiming();
+        for (int k : keys)
+            benchmark::DoNotOptimize(mp.erase(k));
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+void heapSizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(10)->Range(1000, HEAP_BENCH_MAX_SIZE)->Unit(benchmark::kMillisecond);
+}
+
+void mapSizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(10)->Range(1000, MAP_BENCH_MAX_KEYS)->Unit(benchmark::kMillisecond);
+}
+
+void sortSizes(benchmark::internal::Benchmark* b) {
+    for (int64_t n = 1000000; n <= HEAP_BENCH_MAX_SIZE; n *= 10) {
+        for (int64_t threads : {1, 2, 4, 8, 16})
+            b->Args({n, threads});
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+void keyRanges(benchmark::internal::Benchmark* b) {
+    for (int64_t n = 1000; n <= HEAP_BENCH_MAX_SIZE; n *= 10) {
+        for (int64_t range : {int64_t(1) << 10, int64_t(1) << 16, int64_t(1) << 20, int64_t(1) << 30})
+            b->Args({n, range});
+    }
+    b->Unit(benchmark::kMillisecond);
+}
+
+void spillSizes(benchmark::internal::Benchmark* b) {
+    for (int64_t buffered : {1 << 16, 1 << 20, 1 << 24})
+        b->Args({10000000, buffered});
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+} // namespace
+
+BENCHMARK(BM_KVExtractMax)->Apply(heapSizes);
+BENCHMARK(BM_KVHeapSort)->Apply(heapSizes);
+BENCHMARK(BM_KVDrainSorted)->Apply(heapSizes);
+BENCHMARK(BM_KVTopBatch<false>)->Apply(mapSizes);
+BENCHMARK(BM_KVTopBatch<true>)->Apply(mapSizes);
+BENCHMARK(BM_HeapSortEntries)->Apply(sortSizes);
+BENCHMARK(BM_SortEntries)->Apply(keyRanges);
+BENCHMARK(BM_RunSorterSpill)->Apply(spillSizes);
+BENCHMARK(BM_PayloadDrain<PayloadHeap>)->Apply(mapSizes);
+BENCHMARK(BM_PayloadDrain<SoaPayloadHeap>)->Apply(mapSizes);
+BENCHMARK(BM_AddressableUpdate)->RangeMultiplier(10)->Range(1000, 10000000);
+
+BENCHMARK(BM_MapInsert<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_MapInsert<Dist::Zipf>)->Apply(mapSizes);
+BENCHMARK(BM_MapInsertRange<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_MapInsertRange<Dist::Zipf>)->Apply(mapSizes);
+BENCHMARK(BM_MapInsertMaxLatency<false>)->Apply(mapSizes);
+BENCHMARK(BM_MapInsertMaxLatency<true>)->Apply(mapSizes);
+BENCHMARK(BM_MapCount<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_MapCount<Dist::Zipf>)->Apply(mapSizes);
+BENCHMARK(BM_MapCount<Dist::Strided>)->Apply(mapSizes);
+BENCHMARK(BM_DenseCount<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_DenseCount<Dist::Zipf>)->Apply(mapSizes);
+BENCHMARK(BM_DenseCount<Dist::Strided>)->Apply(mapSizes);
+BENCHMARK(BM_MapCountString<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_MapCountString<Dist::Zipf>)->Apply(mapSizes);
+BENCHMARK(BM_MapCountArena<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_MapCountArena<Dist::Zipf>)->Apply(mapSizes);
+BENCHMARK(BM_MapFindHit<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_MapFindHit<Dist::Zipf>)->Apply(mapSizes);
+BENCHMARK(BM_MapFindMiss<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_MapFindMiss<Dist::Zipf>)->Apply(mapSizes);
+BENCHMARK(BM_MapIterate)->Apply(mapSizes);
+BENCHMARK(BM_MapToEntries<false>)->Apply(mapSizes);
+BENCHMARK(BM_MapToEntries<true>)->Apply(mapSizes);
+BENCHMARK(BM_MapSnapshotLoad)->Apply(mapSizes);
+BENCHMARK(BM_MapErase<Dist::Uniform>)->Apply(mapSizes);
+BENCHMARK(BM_MapErase<Dist::Zipf>)->Apply(mapSizes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Compare two Google Benchmark JSON results and flag regressions.
+
+Usage:
+    compare.py baseline.json contender.json [--threshold PCT] [--metric real_time|cpu_time]
+
+Produce the inputs with:
+    bench_dary_heap --benchmark_out=result.json --benchmark_out_format=json
+
+Prints one line per benchmark present in both files with the relative change
+(positive = slower). Exits with status 1 if any benchmark got slower than the
+threshold (default 5%).
+"""
+import argparse
+import json
+import sys
+
+
+def load(path, metric):
+    with open(path) as f:
+        data = json.load(f)
+    results = {}
+    for bench in data.get("benchmarks", []):
+        # Skip mean/median/stddev rows produced by --benchmark_repetitions.
+        if bench.get("run_type") == "aggregate":
+            continue
+        results[bench["name"]] = (bench[metric], bench.get("time_unit", "ns"))
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="regression threshold in percent (default 5)")
+    parser.add_argument("--metric", choices=["real_time", "cpu_time"], default="real_time")
+    args = parser.parse_args()
+
+    base = load(args.baseline, args.metric)
+    cont = load(args.contender, args.metric)
+    common = [name for name in base if name in cont]
+    if not common:
+        print("no benchmarks in common", file=sys.stderr)
+        return 2
+
+    width = max(len(name) for name in common)
+    regressions = 0
+    for name in common:
+        (old, unit), (new, _) = base[name], cont[name]
+        change = (new - old) / old * 100.0 if old else 0.0
+        mark = ""
+        if change > args.threshold:
+            mark = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            mark = "  improved"
+        print(f"{name:<{width}}  {old:12.3f} {unit:>2} -> {new:12.3f} {unit:>2}  {change:+7.1f}%{mark}")
+
+    missing = sorted(set(base) ^ set(cont))
+    if missing:
+        print(f"\n{len(missing)} benchmark(s) present in only one file", file=sys.stderr)
+    print(f"\n{regressions} regression(s) above {args.threshold:g}%")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,446 @@
+// Regression tests for the heaps and the MultiQueue in D-ary_heap.cpp.
+// Each check prints the failing condition and the program exits non-zero.
+#include "D-ary_heap.cpp"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <set>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                          \
+        }                                                                        \
+    } while (0)
+
+// True when data[0 .. n) is a d-ary heap under 'comp': no child is above its parent.
+template<typename T, typename Compare>
+bool isHeap(const T* data, size_t n, size_t d, Compare comp) {
+    for (size_t i = 1; i < n; i++) {
+        if (comp(data[(i - 1) / d], data[i]))
+            return false;
+    }
+    return true;
+}
+
+// 'count' values drawn from a small range, so that ties are common.
+template<typename T>
+vector<T> randomValues(size_t count, uint64_t seed) {
+    mt19937_64 rng(seed);
+    vector<T> values(count);
+    for (auto& v : values)
+        v = static_cast<T>(static_cast<int>(rng() % 512) - 256);
+    return values;
+}
+
+// Inserts, builds and pops a Heap of arity 'd' against a sorted reference. Sizes around
+// full child groups give both full and partial last groups.
+template<typename Heap, typename T, typename Compare>
+void checkHeap(size_t d, Compare comp, Heap prototype) {
+    for (size_t n : { size_t(0), size_t(1), d, d + 1, d * d + 1, d * d + 2, size_t(1000) }) {
+        vector<T> values = randomValues<T>(n, n * 31 + d);
+        vector<T> expected = values;
+        // Highest first, as pop() returns them.
+        sort(expected.begin(), expected.end(), [&](const T& a, const T& b) { return comp(b, a); });
+
+        Heap inserted = prototype;
+        for (const T& v : values)
+            inserted.insert(v);
+        CHECK(inserted.size() == n);
+        CHECK(isHeap(inserted.data(), inserted.size(), d, comp));
+
+        Heap built = prototype;
+        built.build(values);
+        CHECK(isHeap(built.data(), built.size(), d, comp));
+
+        for (Heap* heap : { &inserted, &built }) {
+            vector<T> popped;
+            while (!heap->empty()) {
+                popped.push_back(heap->pop());
+                CHECK(isHeap(heap->data(), heap->size(), d, comp));
+            }
+            CHECK(popped == expected);
+        }
+    }
+}
+
+// Every compile-time arity, the runtime arity, and the cache-aligned layout, for int and
+// float with the default comparator (the ChildScan kernels for d = 8 and 16).
+template<typename T>
+void testAritiesFor() {
+    less<T> comp;
+    checkHeap<MaxHeap<T, 2>, T>(2, comp, MaxHeap<T, 2>());
+    checkHeap<MaxHeap<T, 3>, T>(3, comp, MaxHeap<T, 3>());
+    checkHeap<MaxHeap<T, 4>, T>(4, comp, MaxHeap<T, 4>());
+    checkHeap<MaxHeap<T, 5>, T>(5, comp, MaxHeap<T, 5>());
+    checkHeap<MaxHeap<T, 8>, T>(8, comp, MaxHeap<T, 8>());
+    checkHeap<MaxHeap<T, 16>, T>(16, comp, MaxHeap<T, 16>());
+    for (int d = 1; d <= 9; d++)
+        checkHeap<MaxHeap<T>, T>(d, comp, MaxHeap<T>(d));
+    checkHeap<MaxHeap<T, 4, less<T>, true>, T>(4, comp, MaxHeap<T, 4, less<T>, true>());
+    checkHeap<MaxHeap<T, 8, less<T>, true>, T>(8, comp, MaxHeap<T, 8, less<T>, true>());
+    checkHeap<MaxHeap<T, 16, less<T>, true>, T>(16, comp, MaxHeap<T, 16, less<T>, true>());
+}
+
+void testArities() {
+    testAritiesFor<int>();
+    testAritiesFor<float>();
+}
+
+// std::greater gives a min-heap at every arity and in the cache-aligned layout.
+void testMinHeap() {
+    greater<int> comp;
+    checkHeap<MaxHeap<int, 2, greater<int>>, int>(2, comp, MaxHeap<int, 2, greater<int>>());
+    checkHeap<MaxHeap<int, 4, greater<int>>, int>(4, comp, MaxHeap<int, 4, greater<int>>());
+    checkHeap<MaxHeap<int, 8, greater<int>>, int>(8, comp, MaxHeap<int, 8, greater<int>>());
+    checkHeap<MaxHeap<int, 16, greater<int>>, int>(16, comp, MaxHeap<int, 16, greater<int>>());
+    checkHeap<MaxHeap<int, 0, greater<int>>, int>(3, comp, MaxHeap<int, 0, greater<int>>(3));
+    checkHeap<MaxHeap<int, 8, greater<int>, true>, int>(8, comp, MaxHeap<int, 8, greater<int>, true>());
+    checkHeap<MaxHeap<float, 16, greater<float>>, float>(16, greater<float>(), MaxHeap<float, 16, greater<float>>());
+}
+
+// A comparator that carries state: it orders by one of two keys, chosen at run time.
+struct ByDigit {
+    bool lastDigit = true;
+    bool operator()(int a, int b) const {
+        return lastDigit ? a % 10 < b % 10 : a / 10 < b / 10;
+    }
+};
+
+// Strings, a stateful comparator and std::greater over strings, each with a compile-time
+// and a runtime arity.
+void testComparators() {
+    mt19937_64 rng(5);
+    vector<string> words;
+    for (int i = 0; i < 2000; i++)
+        words.push_back(string(1 + rng() % 6, static_cast<char>('a' + rng() % 4)) + to_string(rng() % 50));
+    vector<string> descending = words;
+    sort(descending.rbegin(), descending.rend());
+    vector<string> ascending(descending.rbegin(), descending.rend());
+
+    MaxHeap<string, 4> strings;
+    MaxHeap<string> runtimeStrings(3);
+    MaxHeap<string, 8, greater<string>> minStrings;
+    for (const auto& w : words) {
+        strings.insert(w);
+        runtimeStrings.emplace(w);
+    }
+    minStrings.build(words);
+    CHECK(isHeap(strings.data(), strings.size(), 4, less<string>()));
+    CHECK(isHeap(minStrings.data(), minStrings.size(), 8, greater<string>()));
+    vector<string> fromStrings, fromRuntime, fromMin;
+    strings.pop_n(words.size(), back_inserter(fromStrings));
+    runtimeStrings.pop_n(words.size(), back_inserter(fromRuntime));
+    minStrings.pop_n(words.size(), back_inserter(fromMin));
+    CHECK(fromStrings == descending);
+    CHECK(fromRuntime == descending);
+    CHECK(fromMin == ascending);
+
+    for (bool lastDigit : { true, false }) {
+        ByDigit comp{ lastDigit };
+        vector<int> values(1000);
+        for (auto& v : values)
+            v = static_cast<int>(rng() % 100);
+        MaxHeap<int, 4, ByDigit> fixed(0, comp);
+        MaxHeap<int, 0, ByDigit> runtime(5, comp);
+        fixed.build(values);
+        for (int v : values)
+            runtime.insert(v);
+        CHECK(isHeap(fixed.data(), fixed.size(), 4, comp));
+        CHECK(isHeap(runtime.data(), runtime.size(), 5, comp));
+        // Equal digits may come out in any order, so compare digit sequences and contents.
+        vector<int> sortedValues = values;
+        sort(sortedValues.begin(), sortedValues.end());
+        auto drainAndCheck = [&](auto& heap) {
+            vector<int> popped;
+            heap.pop_n(values.size(), back_inserter(popped));
+            CHECK(is_sorted(popped.begin(), popped.end(), [&](int a, int b) { return comp(b, a); }));
+            sort(popped.begin(), popped.end());
+            CHECK(popped == sortedValues);
+        };
+        drainAndCheck(fixed);
+        drainAndCheck(runtime);
+    }
+}
+
+// The cache-aligned layout puts every sibling group at the start of a cache line.
+void testCacheAlignedLayout() {
+    MaxHeap<int, 16, less<int>, true> heap;
+    for (int i = 0; i < 100; i++)
+        heap.insert(i);
+    CHECK(reinterpret_cast<uintptr_t>(heap.data() + 1) % cacheLineSize == 0);
+    CHECK(reinterpret_cast<uintptr_t>(heap.data() + 17) % cacheLineSize == 0);
+}
+
+// Position of the first maximum, the scalar reference for ChildScan.
+template<typename T>
+int scalarArgmax(const T* p, int d) {
+    int best = 0;
+    for (int i = 1; i < d; i++) {
+        if (p[best] < p[i])
+            best = i;
+    }
+    return best;
+}
+
+// The vector kernels pick the same child as the scalar scan, including ties and maxima
+// at either edge of the group.
+template<typename T, int D>
+void checkChildScan() {
+    if constexpr (ChildScan<T, D>::enabled) {
+        mt19937_64 rng(D);
+        T group[D];
+        for (int round = 0; round < 20000; round++) {
+            for (int i = 0; i < D; i++)
+                group[i] = static_cast<T>(static_cast<int>(rng() % 5) - 2);
+            // Force the maximum to an edge or make every lane equal.
+            if (round % 4 == 1)
+                group[0] = 100;
+            else if (round % 4 == 2)
+                group[D - 1] = 100;
+            else if (round % 4 == 3)
+                fill(group, group + D, static_cast<T>(-7));
+            CHECK((ChildScan<T, D>::argmax(group)) == scalarArgmax(group, D));
+        }
+        // A maximum in the first and last lanes at once resolves to the first.
+        fill(group, group + D, static_cast<T>(0));
+        group[0] = group[D - 1] = 1;
+        CHECK((ChildScan<T, D>::argmax(group)) == 0);
+        // Extreme values.
+        fill(group, group + D, numeric_limits<T>::lowest());
+        group[D - 1] = numeric_limits<T>::max();
+        CHECK((ChildScan<T, D>::argmax(group)) == D - 1);
+    }
+}
+
+void testChildScan() {
+    checkChildScan<int32_t, 8>();
+    checkChildScan<int32_t, 16>();
+    checkChildScan<float, 8>();
+    checkChildScan<float, 16>();
+    // A NaN lane leaves the vector compare without a match, and the heap falls back to
+    // the scalar scan.
+    if constexpr (ChildScan<float, 8>::enabled) {
+        float group[8] = { 1, 2, NAN, 3, 0, 0, 0, 0 };
+        int best = ChildScan<float, 8>::argmax(group);
+        CHECK(best == -1 || best == 3);
+    }
+}
+
+// A parallel build produces the same array as a serial one.
+void testParallelBuild() {
+    vector<int> values = randomValues<int>(300000, 7);
+    for (int d : { 2, 4, 5 }) {
+        MaxHeap<int> serial(d), parallel(d);
+        serial.build(values);
+        parallel.build(values, 4);
+        CHECK(equal(serial.data(), serial.data() + serial.size(), parallel.data(),
+                    parallel.data() + parallel.size()));
+    }
+    MaxHeap<int, 8, less<int>, true> aligned;
+    aligned.build(values, 4);
+    CHECK(isHeap(aligned.data(), aligned.size(), 8, less<int>()));
+}
+
+// merge(), push_bulk() and pop_n() keep the heap property and lose no element, with
+// small batches (sifted up) and large ones (rebuilt).
+void testBulkOperations() {
+    for (size_t extra : { size_t(0), size_t(3), size_t(5000) }) {
+        vector<int> a = randomValues<int>(2000, 1), b = randomValues<int>(extra, 2);
+        vector<int> all = a;
+        all.insert(all.end(), b.begin(), b.end());
+        sort(all.rbegin(), all.rend());
+
+        MaxHeap<int, 4> merged, other;
+        merged.build(a);
+        other.build(b);
+        merged.merge(std::move(other), 2);
+        CHECK(other.empty());
+        CHECK(isHeap(merged.data(), merged.size(), 4, less<int>()));
+
+        MaxHeap<int, 4> bulk;
+        bulk.build(a);
+        bulk.push_bulk(b);
+        CHECK(isHeap(bulk.data(), bulk.size(), 4, less<int>()));
+
+        vector<int> fromMerge, fromBulk;
+        CHECK(merged.pop_n(all.size() + 10, back_inserter(fromMerge)) == all.size());
+        size_t half = all.size() / 2;
+        CHECK(bulk.pop_n(half, back_inserter(fromBulk)) == half);
+        CHECK(isHeap(bulk.data(), bulk.size(), 4, less<int>()));
+        bulk.pop_n(all.size(), back_inserter(fromBulk));
+        CHECK(fromMerge == all);
+        CHECK(fromBulk == all);
+    }
+    // Merging into an empty heap, and a heap into itself.
+    MaxHeap<int, 2> empty, full;
+    full.build(randomValues<int>(100, 3));
+    empty.merge(std::move(full));
+    CHECK(empty.size() == 100 && full.empty());
+    empty.merge(std::move(empty));
+    CHECK(empty.size() == 100);
+}
+
+// PairingMaxHeap against a sorted reference, with builds, merges and moves.
+void testPairingHeap() {
+    mt19937_64 rng(11);
+    PairingMaxHeap<int> heap;
+    vector<int> reference;
+    for (int step = 0; step < 20000; step++) {
+        if (rng() % 3 != 0 || reference.empty()) {
+            int v = static_cast<int>(rng() % 1000);
+            heap.insert(v);
+            reference.push_back(v);
+        }
+        else {
+            auto top = max_element(reference.begin(), reference.end());
+            CHECK(heap.top() == *top);
+            CHECK(heap.pop() == *top);
+            reference.erase(top);
+        }
+        CHECK(heap.size() == reference.size());
+    }
+
+    PairingMaxHeap<int> other;
+    vector<int> extra = randomValues<int>(500, 12);
+    other.build(extra);
+    heap.merge(std::move(other));
+    CHECK(other.empty());
+    reference.insert(reference.end(), extra.begin(), extra.end());
+
+    PairingMaxHeap<int> moved(std::move(heap));
+    CHECK(heap.empty());
+    PairingMaxHeap<int> assigned;
+    assigned.insert(1);
+    assigned = std::move(moved);
+    sort(reference.rbegin(), reference.rend());
+    vector<int> popped;
+    while (!assigned.empty())
+        popped.push_back(assigned.pop());
+    CHECK(popped == reference);
+
+    PairingMaxHeap<int, greater<int>> minHeap;
+    minHeap.build({ 5, 1, 4, 2, 3 });
+    CHECK(minHeap.pop() == 1 && minHeap.pop() == 2);
+}
+
+// Memory resource that records its live blocks, so that a block freed through the wrong
+// resource, or never freed, is caught.
+class TrackingResource : public pmr::memory_resource {
+public:
+    set<void*> live;
+    bool foreignFree = false;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* p = pmr::new_delete_resource()->allocate(bytes, alignment);
+        live.insert(p);
+        return p;
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (live.erase(p) == 0)
+            foreignFree = true;
+        pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// A PairingMaxHeap over polymorphic allocators can be moved, move-assigned and merged
+// within one resource and across two; every node is freed by the resource it came from.
+void testPairingHeapPmr() {
+    using PmrPairing = PairingMaxHeap<int, less<int>, pmr::polymorphic_allocator<int>>;
+    TrackingResource first, second;
+    {
+        PmrPairing a(less<int>(), &first), b(less<int>(), &first), c(less<int>(), &second);
+        for (int i = 0; i < 100; i++) {
+            a.insert(i);
+            b.insert(1000 + i);
+            c.insert(2000 + i);
+        }
+        // Same resource: the nodes are spliced.
+        a.merge(std::move(b));
+        CHECK(a.size() == 200 && b.empty());
+        // Different resources: the values move into nodes of 'a'.
+        a.merge(std::move(c));
+        CHECK(a.size() == 300 && c.empty());
+        CHECK(second.live.empty());
+        CHECK(a.top() == 2099);
+
+        PmrPairing moved(std::move(a));
+        CHECK(moved.size() == 300 && a.empty());
+        PmrPairing elsewhere(less<int>(), &second);
+        elsewhere.insert(-1);
+        elsewhere = std::move(moved);
+        CHECK(elsewhere.size() == 300 && moved.empty());
+        CHECK(first.live.empty());
+        int previous = elsewhere.top();
+        while (!elsewhere.empty()) {
+            int v = elsewhere.pop();
+            CHECK(v <= previous);
+            previous = v;
+        }
+    }
+    CHECK(first.live.empty() && second.live.empty());
+    CHECK(!first.foreignFree && !second.foreignFree);
+}
+
+// Four threads push and pop concurrently; every pushed value comes out exactly once,
+// either from a concurrent try_pop() or from the final drain.
+void testMultiQueueStress() {
+    constexpr int threads = 4;
+    constexpr int perThread = 50000;
+    MultiQueue<int> queue(threads);
+    vector<vector<int>> popped(threads);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < perThread; i++) {
+                queue.push(t * perThread + i);
+                int out;
+                if (i % 2 == 1 && queue.try_pop(out))
+                    popped[t].push_back(out);
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    vector<int> all;
+    for (auto& p : popped)
+        all.insert(all.end(), p.begin(), p.end());
+    int out;
+    while (queue.try_pop(out))
+        all.push_back(out);
+    sort(all.begin(), all.end());
+    CHECK(all.size() == static_cast<size_t>(threads * perThread));
+    bool exact = true;
+    for (size_t i = 0; i < all.size(); i++)
+        exact = exact && all[i] == static_cast<int>(i);
+    CHECK(exact);
+    CHECK(!queue.try_pop(out));
+}
+
+} // namespace
+
+int main() {
+    testArities();
+    testMinHeap();
+    testComparators();
+    testCacheAlignedLayout();
+    testChildScan();
+    testParallelBuild();
+    testBulkOperations();
+    testPairingHeap();
+    testPairingHeapPmr();
+    testMultiQueueStress();
+    if (failures == 0)
+        printf("all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,392 @@
+// Regression tests for the UnorderedMap and heaps in Sorting_by_frequency.cpp.
+// Each check prints the failing condition and the program exits non-zero.
+#include "Sorting_by_frequency.cpp"
+
+#include <cstdio>
+#include <map>
+#include <random>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                          \
+        }                                                                        \
+    } while (0)
+
+// A PmrUnorderedMap can be moved, move-assigned and drained: its allocator does not
+// propagate on swap, so the tables are exchanged without touching it.
+void testPmrMoveAndDrain() {
+    pmr::monotonic_buffer_resource arena;
+    PmrUnorderedMap<int, int> counts(&arena);
+    for (int i = 0; i < 1000; i++)
+        counts[i % 100]++;
+
+    PmrUnorderedMap<int, int> moved(std::move(counts));
+    CHECK(moved.size() == 100);
+    CHECK(counts.size() == 0);
+
+    PmrUnorderedMap<int, int> assigned(&arena);
+    assigned = std::move(moved);
+    CHECK(assigned.size() == 100);
+
+    // Move assignment across resources copies the nodes into the target's resource.
+    pmr::monotonic_buffer_resource other;
+    PmrUnorderedMap<int, int> elsewhere(&other);
+    elsewhere = std::move(assigned);
+    CHECK(elsewhere.size() == 100);
+    CHECK(elsewhere.get_allocator().resource() == &other);
+
+    long long total = 0;
+    size_t keys = 0;
+    elsewhere.drain([&](int key, int value) {
+        CHECK(key >= 0 && key < 100);
+        total += value;
+        keys++;
+    });
+    CHECK(keys == 100);
+    CHECK(total == 1000);
+    CHECK(elsewhere.size() == 0);
+}
+
+// Reads every int of 'text' and returns whether the reader threw; 'count' is the
+// number of values that must be read before that.
+bool readThrows(const char* text, int count) {
+    FILE* f = tmpfile();
+    fputs(text, f);
+    rewind(f);
+    IntReader reader(f);
+    int x = 0, read = 0;
+    bool threw = false;
+    try {
+        while (reader.next(x))
+            read++;
+    }
+    catch (const runtime_error&) {
+        threw = true;
+    }
+    fclose(f);
+    CHECK(read == count);
+    return threw;
+}
+
+// IntReader parses the full int range, including numeric_limits<int>::min(), and
+// rejects tokens that do not fit.
+void testIntReaderRange() {
+    FILE* f = tmpfile();
+    fputs("-2147483648 2147483647 -0 17", f);
+    rewind(f);
+    IntReader reader(f);
+    int x = 0;
+    CHECK(reader.next(x) && x == numeric_limits<int>::min());
+    CHECK(reader.next(x) && x == numeric_limits<int>::max());
+    CHECK(reader.next(x) && x == 0);
+    CHECK(reader.next(x) && x == 17);
+    CHECK(!reader.next(x));
+    fclose(f);
+
+    for (const char* token : { "2147483648", "-2147483649", "99999999999" })
+        CHECK(readThrows(token, 0));
+}
+
+// A sign without digits and any non-numeric byte are parse errors, raised at the token
+// that holds them; the tokens before it are read normally.
+void testIntReaderMalformed() {
+    CHECK(readThrows("1 2 - 3 2", 2));
+    CHECK(readThrows("7 -\n", 1));
+    CHECK(readThrows("x", 0));
+    CHECK(readThrows("1.5", 0));
+    CHECK(readThrows("4 3x 1", 1));
+    CHECK(readThrows("+-1", 0));
+    CHECK(!readThrows(" \t+12\r\n-3\n", 2));
+}
+
+// A range hint wider than the input warrants gives the hash map instead of a window.
+void testDenseRangeCap() {
+    auto small = DenseCountMap<int, int>::forRange(-10, 10, 100);
+    CHECK(small.windowSize() == 21);
+    auto full = DenseCountMap<int, int>::forRange(numeric_limits<int>::min(), numeric_limits<int>::max(), 100);
+    CHECK(full.windowSize() == 0);
+    auto wide = DenseCountMap<int, int>::forRange(0, 500000000, 100000);
+    CHECK(wide.windowSize() == 0);
+    full[numeric_limits<int>::min()]++;
+    CHECK(full.size() == 1);
+}
+
+// A map snapshot round-trips, and a file whose control bytes disagree with its header
+// or leave no empty slot is rejected instead of being loaded.
+void testMapSnapshot() {
+    string path = "test_frequency_snapshot.bin";
+    UnorderedMap<int, int> counts;
+    for (int i = 0; i < 100; i++)
+        counts[i * 7] += i + 1;
+    counts.saveSnapshot(path.c_str());
+    UnorderedMap<int, int> loaded = UnorderedMap<int, int>::loadSnapshot(path.c_str());
+    CHECK(loaded.size() == 100);
+    CHECK(loaded[7 * 42] == 43);
+
+    // Mark every control byte full: no empty slot is left and the count is wrong.
+    SnapshotHeader header;
+    FILE* f = fopen(path.c_str(), "r+b");
+    CHECK(fread(&header, sizeof(header), 1, f) == 1);
+    vector<char> ctrl(header.length[0], 0);
+    fseek(f, static_cast<long>(header.offset[0]), SEEK_SET);
+    fwrite(ctrl.data(), 1, ctrl.size(), f);
+    fclose(f);
+    bool threw = false;
+    try {
+        UnorderedMap<int, int>::loadSnapshot(path.c_str());
+    }
+    catch (const runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    remove(path.c_str());
+}
+
+// A heap snapshot round-trips, and a count whose byte size wraps around to the section
+// length is rejected instead of being allocated.
+void testHeapSnapshotCount() {
+    string path = "test_frequency_heap.bin";
+    MaxHeap<int, int> heap(4);
+    for (int i = 0; i < 100; i++)
+        heap.insert(KVNode<int, int>(i * 31 % 100, i));
+    heap.saveSnapshot(path.c_str());
+    MaxHeap<int, int> loaded = MaxHeap<int, int>::loadSnapshot(path.c_str());
+    CHECK(loaded.size() == 100);
+    CHECK(loaded.pop().key == 99);
+
+    SnapshotHeader header;
+    FILE* f = fopen(path.c_str(), "r+b");
+    CHECK(fread(&header, sizeof(header), 1, f) == 1);
+    header.count += uint64_t(1) << (64 - 3); // Times sizeof(KVNode<int, int>) == 8, this wraps.
+    fseek(f, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, f);
+    fclose(f);
+    bool threw = false;
+    try {
+        MaxHeap<int, int>::loadSnapshot(path.c_str());
+    }
+    catch (const runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    remove(path.c_str());
+}
+
+// topK agrees with a full sort of the values for k = 0, k inside the table and k at or
+// beyond its size. Many values tie, so only the value sequence is fixed; each returned
+// key must be distinct and carry its own value.
+void testTopK() {
+    UnorderedMap<int, int> counts;
+    mt19937 rng(11);
+    for (int i = 0; i < 5000; i++)
+        counts[static_cast<int>(rng() % 1000)] += static_cast<int>(rng() % 5);
+    vector<int> values;
+    counts.for_each([&](int, int value) { values.push_back(value); });
+    sort(values.begin(), values.end(), greater<int>());
+    for (size_t k : { size_t(0), size_t(1), size_t(10), size_t(500), counts.size(), counts.size() + 10 }) {
+        vector<KVNode<int, int>> top = counts.topK(k);
+        CHECK(top.size() == min(k, counts.size()));
+        bool same = true;
+        std::map<int, int> seen;
+        for (size_t i = 0; i < top.size(); i++) {
+            const int* value = counts.find(top[i].key);
+            same = same && top[i].value == values[i] && value && *value == top[i].value;
+            same = same && seen.emplace(top[i].key, top[i].value).second;
+        }
+        CHECK(same);
+    }
+}
+
+// The external sort keeps equal keys in the order they were added, across spilled runs
+// and merged levels.
+void testRunSorterStable() {
+    RunSorter<int, int> sorter(7);
+    for (int i = 0; i < 5000; i++)
+        sorter.add(KVNode<int, int>(i % 3, i));
+    int lastKey = -1, lastValue = -1;
+    size_t seen = 0;
+    sorter.finish([&](const KVNode<int, int>& node) {
+        CHECK(node.key >= lastKey);
+        if (node.key == lastKey)
+            CHECK(node.value > lastValue);
+        lastKey = node.key;
+        lastValue = node.value;
+        seen++;
+    });
+    CHECK(seen == 5000);
+}
+
+// The radix sort accepts empty and single-entry input.
+void testRadixSortSmall() {
+    CHECK(radixSortByKey(vector<KVNode<int, int>>()).empty());
+    vector<KVNode<int, int>> one;
+    one.emplace_back(5, 1);
+    vector<KVNode<int, int>> sorted = radixSortByKey(std::move(one));
+    CHECK(sorted.size() == 1 && sorted[0].key == 5);
+}
+
+// Parallel counting merges the per-thread maps into the same counts as one thread.
+void testParallelCount() {
+    vector<string> in;
+    for (int i = 0; i < 20000; i++)
+        in.push_back("key" + to_string(i % 97));
+    UnorderedMap<string, int> counts = countFrequencies(in, 5);
+    CHECK(counts.size() == 97);
+    long long total = 0;
+    counts.for_each([&](const string&, int count) { total += count; });
+    CHECK(total == 20000);
+    CHECK(counts["key0"] == 207);
+}
+
+// AddressableMaxHeap against a reference map from handle to node under random inserts,
+// key updates in both directions, erases and pops, for several arities.
+void testAddressableHeapRandom() {
+    for (int d : { 2, 3, 4 }) {
+        mt19937_64 rng(d);
+        AddressableMaxHeap<int, int> heap(d);
+        map<size_t, KVNode<int, int>> live;
+        // The reference top key: the largest key among the live nodes.
+        auto topKey = [&] {
+            int best = numeric_limits<int>::min();
+            for (auto& [h, node] : live)
+                best = max(best, node.key);
+            return best;
+        };
+        for (int step = 0; step < 20000; step++) {
+            int op = static_cast<int>(rng() % 6);
+            int key = static_cast<int>(rng() % 1000);
+            if (op <= 1 || live.empty()) {
+                size_t h = heap.emplace(key, step);
+                CHECK(live.count(h) == 0);
+                live.emplace(h, KVNode<int, int>(key, step));
+            }
+            else {
+                auto it = next(live.begin(), static_cast<long>(rng() % live.size()));
+                size_t h = it->first;
+                if (op == 2 || op == 3) {
+                    // Update up (op 2) or down (op 3) from the current key.
+                    int newKey = op == 2 ? it->second.key + key : it->second.key - key;
+                    heap.update(h, newKey);
+                    it->second.key = newKey;
+                }
+                else if (op == 4) {
+                    KVNode<int, int> removed = heap.erase(h);
+                    CHECK(removed.key == it->second.key && removed.value == it->second.value);
+                    CHECK(!heap.contains(h));
+                    live.erase(it);
+                }
+                else {
+                    CHECK(heap.top().key == topKey());
+                    size_t h = heap.topHandle();
+                    KVNode<int, int> popped = heap.pop();
+                    CHECK(live.count(h) == 1 && live.at(h).value == popped.value);
+                    live.erase(h);
+                }
+            }
+            CHECK(heap.size() == live.size());
+            if (!live.empty())
+                CHECK(heap.top().key == topKey());
+        }
+        for (auto& [h, node] : live) {
+            CHECK(heap.contains(h));
+            CHECK(heap.get(h).key == node.key && heap.get(h).value == node.value);
+        }
+
+        // Erasing the root through its handle.
+        size_t root = heap.topHandle();
+        heap.erase(root);
+        live.erase(root);
+        CHECK(heap.size() == live.size() && heap.top().key == topKey());
+
+        // A new lowest key stays in the last slot; erasing it touches no other node.
+        size_t last = heap.emplace(numeric_limits<int>::min(), -1);
+        heap.erase(last);
+        CHECK(heap.size() == live.size() && heap.top().key == topKey());
+
+        // The freed handle is handed out again and refers to the new node.
+        size_t reused = heap.emplace(5, 55);
+        CHECK(reused == last);
+        CHECK(heap.contains(reused) && heap.get(reused).value == 55);
+        live.emplace(reused, KVNode<int, int>(5, 55));
+
+        // Popping everything yields the keys in descending order.
+        int previous = numeric_limits<int>::max();
+        while (!heap.empty()) {
+            KVNode<int, int> node = heap.pop();
+            CHECK(node.key <= previous);
+            previous = node.key;
+        }
+    }
+}
+
+// Dense counting gives the hash map's counts with one thread, with per-thread copies of
+// a small window, and with a large window split between the threads; keys outside the
+// window are counted once.
+void testDenseParallelCount() {
+    mt19937_64 rng(3);
+    vector<int> in(200000);
+    for (auto& v : in)
+        v = rng() % 16 == 0 ? static_cast<int>(rng()) : static_cast<int>(rng() % 3000000);
+    UnorderedMap<int, int> reference = countFrequencies(in, 1);
+    for (auto [range, threads] : { pair<size_t, unsigned>(1000, 1), pair<size_t, unsigned>(1000, 4),
+                                   pair<size_t, unsigned>(size_t(1) << 21, 4), pair<size_t, unsigned>(3000000, 7) }) {
+        DenseCountMap<int, int> counts = countFrequencies(in, DenseCountMap<int, int>(0, range), threads);
+        CHECK(counts.size() == reference.size());
+        bool same = true;
+        counts.for_each([&](int key, int count) {
+            const int* expected = reference.find(key);
+            same = same && expected && *expected == count;
+        });
+        CHECK(same);
+    }
+}
+
+// An incremental map agrees with std::map across many resizes, including the ones that
+// take over control bytes prepared ahead of time and the tombstone-only rehashes.
+void testIncrementalRandom() {
+    UnorderedMap<int, int> map;
+    map.setIncrementalRehash(true);
+    std::map<int, int> ref;
+    mt19937 rng(7);
+    for (int step = 0; step < 200000; step++) {
+        int key = static_cast<int>(rng() % 50000);
+        if (rng() % 4 == 0) {
+            CHECK(map.erase(key) == (ref.erase(key) == 1));
+        } else {
+            map[key] += step;
+            ref[key] += step;
+        }
+    }
+    CHECK(map.size() == ref.size());
+    for (const auto& [key, value] : ref) {
+        const int* found = map.find(key);
+        CHECK(found && *found == value);
+    }
+}
+
+} // namespace
+
+int main() {
+    testPmrMoveAndDrain();
+    testIntReaderRange();
+    testIntReaderMalformed();
+    testDenseRangeCap();
+    testMapSnapshot();
+    testHeapSnapshotCount();
+    testTopK();
+    testRunSorterStable();
+    testRadixSortSmall();
+    testParallelCount();
+    testAddressableHeapRandom();
+    testDenseParallelCount();
+    testIncrementalRandom();
+    if (failures == 0)
+        printf("all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}